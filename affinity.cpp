@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <algorithm>
+#include <exception>
+#include <new>
+#include "affinity.h"
+
+// 读取一个只含整数的sysfs文件，失败返回def
+static int readSysInt(const char* path, int def) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return def;
+    }
+    int value = def;
+    if (fscanf(f, "%d", &value) != 1) {
+        value = def;
+    }
+    fclose(f);
+    return value;
+}
+
+// 读取一个CPU列表形式的sysfs文件
+static bool readSysCpuList(const char* path, std::vector<int>& result) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    char line[4096];
+    bool ok = fgets(line, sizeof(line), f) != nullptr;
+    fclose(f);
+    if (!ok) {
+        return false;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    return parseCpuList(line, result);
+}
+
+// 解析"0,2,4-7"形式的CPU列表
+bool parseCpuList(const char* text, std::vector<int>& result) {
+    const char* p = text;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return false;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return false;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            result.push_back((int)cpu);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 构造函数
+CpuLayout::CpuLayout(AFFINITY_POLICY _policy, const char* cpuList, int _reactorNums) :
+    policy(_policy), nodeCount(1), reactorNums(_reactorNums)
+{
+    readTopology();
+    if (policy == AFFINITY_NONE) {
+        return;
+    }
+
+    if (policy == AFFINITY_LIST) {
+        // 按给定的顺序使用，每个CPU都必须可用
+        if (!cpuList || !parseCpuList(cpuList, order) || order.empty()) {
+            throw std::exception();
+        }
+        for (size_t i = 0; i < order.size(); i++) {
+            if (!find(order[i])) {
+                throw std::exception();
+            }
+        }
+        return;
+    }
+
+    std::vector<CpuInfo> sorted = cpus;
+    if (policy == AFFINITY_COMPACT) {
+        // 紧凑：填满一个节点再用下一个，同一物理核的超线程相邻
+        std::sort(sorted.begin(), sorted.end(), [](const CpuInfo& a, const CpuInfo& b) {
+            if (a.node != b.node) return a.node < b.node;
+            if (a.package != b.package) return a.package < b.package;
+            if (a.core != b.core) return a.core < b.core;
+            return a.cpu < b.cpu;
+        });
+        for (size_t i = 0; i < sorted.size(); i++) {
+            order.push_back(sorted[i].cpu);
+        }
+        return;
+    }
+
+    // 分散：各节点轮流取，每个节点内先用完所有物理核的第一个超线程
+    std::sort(sorted.begin(), sorted.end(), [](const CpuInfo& a, const CpuInfo& b) {
+        if (a.sibling != b.sibling) return a.sibling < b.sibling;
+        if (a.package != b.package) return a.package < b.package;
+        if (a.core != b.core) return a.core < b.core;
+        return a.cpu < b.cpu;
+    });
+    std::vector<std::vector<int>> perNode(nodeCount);
+    for (size_t i = 0; i < sorted.size(); i++) {
+        perNode[sorted[i].node].push_back(sorted[i].cpu);
+    }
+    for (size_t round = 0; order.size() < sorted.size(); round++) {
+        for (int node = 0; node < nodeCount; node++) {
+            if (round < perNode[node].size()) {
+                order.push_back(perNode[node][round]);
+            }
+        }
+    }
+}
+
+// 读取/sys下的拓扑
+void CpuLayout::readTopology() {
+    std::vector<int> online;
+    if (!readSysCpuList("/sys/devices/system/cpu/online", online)) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < n; i++) {
+            online.push_back((int)i);
+        }
+    }
+
+    // 只使用本进程允许运行的CPU，例如被taskset或cgroup限制时
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    char path[128];
+    for (size_t i = 0; i < online.size(); i++) {
+        int cpu = online[i];
+        if (haveMask && cpu < CPU_SETSIZE && !CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        CpuInfo info;
+        info.cpu = cpu;
+        info.node = 0;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        info.package = readSysInt(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        info.core = readSysInt(path, cpu);
+        info.sibling = 0;
+        cpus.push_back(info);
+    }
+
+    // 没有NUMA信息时视为只有一个节点
+    for (int node = 0; ; node++) {
+        std::vector<int> nodeCpus;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (!readSysCpuList(path, nodeCpus)) {
+            break;
+        }
+        nodeCount = node + 1;
+        for (size_t i = 0; i < nodeCpus.size(); i++) {
+            for (size_t j = 0; j < cpus.size(); j++) {
+                if (cpus[j].cpu == nodeCpus[i]) {
+                    cpus[j].node = node;
+                }
+            }
+        }
+    }
+
+    // 同一物理核上的超线程按CPU编号排序号
+    for (size_t i = 0; i < cpus.size(); i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (cpus[j].package == cpus[i].package && cpus[j].core == cpus[i].core) {
+                cpus[i].sibling++;
+            }
+        }
+    }
+}
+
+// 按CPU编号查找拓扑信息
+const CpuLayout::CpuInfo* CpuLayout::find(int cpu) const {
+    for (size_t i = 0; i < cpus.size(); i++) {
+        if (cpus[i].cpu == cpu) {
+            return &cpus[i];
+        }
+    }
+    return nullptr;
+}
+
+// 第id个反应堆绑定的CPU
+int CpuLayout::reactorCpu(int id) const {
+    if (order.empty()) {
+        return -1;
+    }
+    return order[id % order.size()];
+}
+
+// 工作线程依次绑定的CPU，从反应堆之后开始循环使用所有CPU
+std::vector<int> CpuLayout::workerCpus() const {
+    std::vector<int> result;
+    for (size_t i = 0; i < order.size(); i++) {
+        result.push_back(order[(reactorNums + i) % order.size()]);
+    }
+    return result;
+}
+
+// CPU所在的NUMA节点
+int CpuLayout::nodeOf(int cpu) const {
+    const CpuInfo* info = find(cpu);
+    return info ? info->node : -1;
+}
+
+// 打印拓扑和选定的布局
+void CpuLayout::printReport(int maxThreads) const {
+    static const char* names[] = {"none", "compact", "scatter", "list"};
+    printf("cpu layout: %zu cpus on %d numa node(s), policy %s\n", cpus.size(), nodeCount, names[policy]);
+    if (order.empty()) {
+        printf("    threads are not pinned, memory is placed on first touch\n");
+        return;
+    }
+    for (int i = 0; i < reactorNums; i++) {
+        int cpu = reactorCpu(i);
+        printf("    reactor %d -> cpu %d (node %d)\n", i, cpu, nodeOf(cpu));
+    }
+    std::vector<int> workers = workerCpus();
+    printf("    workers ->");
+    for (int i = 0; i < maxThreads; i++) {
+        int cpu = workers[i % workers.size()];
+        printf(" %d:%d", i, cpu);
+    }
+    printf(" (worker:cpu)\n");
+}
+
+// 把当前线程绑定到cpu上
+bool pinCurrentThread(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// 当前线程所在的NUMA节点
+int currentNode() {
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+        return 0;
+    }
+    return (int)node;
+}
+
+// 分配内存，node不为-1时优先放在该节点上
+void* allocOnNode(size_t size, int node) {
+    void* addr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    // 只是偏好，节点内存不足时仍可从其他节点分配，不支持NUMA的内核上忽略失败
+    if (node >= 0 && node < (int)(sizeof(unsigned long) * 8)) {
+        unsigned long mask = 1UL << node;
+        syscall(SYS_mbind, addr, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0);
+    }
+    return addr;
+}
+
+// 释放allocOnNode分配的内存
+void freeOnNode(void* addr, size_t size) {
+    munmap(addr, size);
+}
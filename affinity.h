@@ -0,0 +1,74 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+#include <vector>
+#include "config.h"
+
+// CPU拓扑以及反应堆和工作线程在CPU上的布局
+// 拓扑从/sys/devices/system读取，只使用本进程允许运行的CPU
+class CpuLayout {
+public:
+    // 构造函数，按策略排出CPU的使用顺序，前_reactorNums个给反应堆，其余给工作线程
+    // policy为AFFINITY_LIST时使用cpuList（如"0,2,4-7"），格式错误或包含不可用的CPU时抛出异常
+    CpuLayout(AFFINITY_POLICY _policy, const char* cpuList, int _reactorNums);
+
+    // 第id个反应堆绑定的CPU，不绑定时返回-1
+    int reactorCpu(int id) const;
+
+    // 工作线程依次绑定的CPU，排在反应堆之后，不绑定时为空
+    std::vector<int> workerCpus() const;
+
+    // CPU所在的NUMA节点，cpu为-1时返回-1
+    int nodeOf(int cpu) const;
+
+    // 打印拓扑和选定的布局
+    void printReport(int maxThreads) const;
+
+private:
+    // 一个CPU的拓扑信息
+    struct CpuInfo {
+        int cpu;
+        int node;
+        int package;
+        int core;
+        int sibling;    // 在同一物理核上的超线程中的序号
+    };
+
+    // 读取/sys下的拓扑
+    void readTopology();
+
+    // 按CPU编号查找拓扑信息
+    const CpuInfo* find(int cpu) const;
+
+private:
+    AFFINITY_POLICY policy;
+
+    // 可用CPU的拓扑信息
+    std::vector<CpuInfo> cpus;
+
+    // NUMA节点个数
+    int nodeCount;
+
+    // 按策略排好的CPU顺序，反应堆占前面reactorNums个
+    std::vector<int> order;
+    int reactorNums;
+};
+
+// 解析"0,2,4-7"形式的CPU列表，格式错误返回false
+bool parseCpuList(const char* text, std::vector<int>& result);
+
+// 把当前线程绑定到cpu上，返回是否成功
+bool pinCurrentThread(int cpu);
+
+// 当前线程所在的NUMA节点
+int currentNode();
+
+// 分配size字节的匿名内存，node不为-1时优先放在该NUMA节点上，否则由首次访问的线程决定
+// 失败时抛出std::bad_alloc
+void* allocOnNode(size_t size, int node);
+
+// 释放allocOnNode分配的内存
+void freeOnNode(void* addr, size_t size);
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstdio>
+#include <vector>
+#include <atomic>
+#include "locker.h"
+#include "affinity.h"
+
+// I/O缓冲区池，模板参数SIZE为缓冲区大小
+// 每个线程缓存一批空闲缓冲区，存取不加锁；缓存过多或为空时与所在NUMA节点的全局池成批交换
+// 缓冲区在借出线程所在的节点上分配，归还时回到所属节点的全局池，不会在节点之间漂移
+template <int SIZE>
+class BufferPool {
+public:
+    // 每个线程最多缓存的空闲缓冲区个数
+    static const int CACHE_MAX = 256;
+
+    // 线程缓存与全局池之间每次交换的缓冲区个数
+    static const int BATCH = 32;
+
+    // 支持的NUMA节点个数，更多的节点按取模合并
+    static const int MAX_NODES = 16;
+
+    // 缓冲区前的头部，记录所属的节点，保持缓冲区按缓存行对齐
+    static const int HEADER_SIZE = 64;
+
+    // 借出一个缓冲区，内容未初始化
+    static char* acquire();
+
+    // 归还缓冲区，可以在与借出时不同的线程中归还
+    static void release(char* buf);
+
+    // 打印缓冲区的使用情况
+    static void printStats();
+
+private:
+    // 线程本地的空闲缓冲区，只存放本节点的缓冲区，线程退出时归还给全局池
+    struct ThreadCache {
+        ThreadCache() : node(-1) {}
+        ~ThreadCache();
+
+        // 线程所在的节点，第一次使用时确定，线程需在此之前绑定CPU
+        int node;
+        std::vector<char*> bufs;
+    };
+
+    // 每个节点的全局池及其互斥锁
+    struct Depot {
+        Depot() : locker("buffer depot") {}
+
+        Locker locker;
+        std::vector<char*> bufs;
+    };
+
+    // 获取当前线程的缓存，并确定其所在的节点
+    static ThreadCache& localCache();
+
+    // 缓冲区所属的节点
+    static int nodeOf(char* buf) {
+        return *(int*)(buf - HEADER_SIZE);
+    }
+
+    static thread_local ThreadCache cache;
+
+    static Depot depots[MAX_NODES];
+
+    // 借出中的缓冲区个数、峰值以及已分配的总个数
+    static std::atomic<long> inUse;
+    static std::atomic<long> peakInUse;
+    static std::atomic<long> allocated;
+};
+
+template <int SIZE>
+thread_local typename BufferPool<SIZE>::ThreadCache BufferPool<SIZE>::cache;
+
+template <int SIZE>
+typename BufferPool<SIZE>::Depot BufferPool<SIZE>::depots[MAX_NODES];
+
+template <int SIZE>
+std::atomic<long> BufferPool<SIZE>::inUse(0);
+
+template <int SIZE>
+std::atomic<long> BufferPool<SIZE>::peakInUse(0);
+
+template <int SIZE>
+std::atomic<long> BufferPool<SIZE>::allocated(0);
+
+// 获取当前线程的缓存
+template <int SIZE>
+typename BufferPool<SIZE>::ThreadCache& BufferPool<SIZE>::localCache() {
+    if (cache.node < 0) {
+        cache.node = currentNode() % MAX_NODES;
+    }
+    return cache;
+}
+
+// 借出一个缓冲区
+template <int SIZE>
+char* BufferPool<SIZE>::acquire() {
+    ThreadCache& local = localCache();
+    std::vector<char*>& bufs = local.bufs;
+    if (bufs.empty()) {
+        // 从本节点的全局池取一批
+        Depot& depot = depots[local.node];
+        depot.locker.lock();
+        int n = 0;
+        while (n < BATCH && !depot.bufs.empty()) {
+            bufs.push_back(depot.bufs.back());
+            depot.bufs.pop_back();
+            n++;
+        }
+        depot.locker.unlock();
+
+        // 全局池也为空时在本节点上新分配一批，每个缓冲区前写入所属的节点
+        if (n < BATCH) {
+            const size_t stride = HEADER_SIZE + SIZE;
+            char* chunk = (char*)allocOnNode(stride * (BATCH - n), local.node);
+            for (; n < BATCH; n++, chunk += stride) {
+                *(int*)chunk = local.node;
+                bufs.push_back(chunk + HEADER_SIZE);
+                allocated.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    char* buf = bufs.back();
+    bufs.pop_back();
+
+    long used = inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (used > peakInUse.load(std::memory_order_relaxed)) {
+        peakInUse.store(used, std::memory_order_relaxed);
+    }
+    return buf;
+}
+
+// 归还缓冲区
+template <int SIZE>
+void BufferPool<SIZE>::release(char* buf) {
+    inUse.fetch_sub(1, std::memory_order_relaxed);
+
+    ThreadCache& local = localCache();
+    int node = nodeOf(buf);
+    if (node != local.node) {
+        // 在其他节点上借出的缓冲区直接还给所属节点，只在多节点且线程跨节点处理连接时发生
+        Depot& depot = depots[node];
+        depot.locker.lock();
+        depot.bufs.push_back(buf);
+        depot.locker.unlock();
+        return;
+    }
+
+    std::vector<char*>& bufs = local.bufs;
+    bufs.push_back(buf);
+    if ((int)bufs.size() <= CACHE_MAX) {
+        return;
+    }
+
+    // 线程缓存过多，归还一批给本节点的全局池，供同节点的其他线程使用
+    Depot& depot = depots[local.node];
+    depot.locker.lock();
+    for (int i = 0; i < BATCH; i++) {
+        depot.bufs.push_back(bufs.back());
+        bufs.pop_back();
+    }
+    depot.locker.unlock();
+}
+
+// 打印缓冲区的使用情况
+template <int SIZE>
+void BufferPool<SIZE>::printStats() {
+    long total = allocated.load(std::memory_order_relaxed);
+    printf("io buffers: in use %ld, peak %ld, allocated %ld (%ld KB of %d-byte buffers)\n",
+           inUse.load(std::memory_order_relaxed), peakInUse.load(std::memory_order_relaxed),
+           total, total * SIZE / 1024, SIZE);
+}
+
+// 线程退出时归还缓存的缓冲区
+template <int SIZE>
+BufferPool<SIZE>::ThreadCache::~ThreadCache() {
+    if (node < 0) {
+        return;
+    }
+    Depot& depot = depots[node];
+    depot.locker.lock();
+    depot.bufs.insert(depot.bufs.end(), bufs.begin(), bufs.end());
+    depot.locker.unlock();
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <exception>
+#include "bundle.h"
+
+// 打开并映射资源包
+Bundle::Bundle(const char* path) : base(nullptr), size(0), header(nullptr), slots(nullptr), entries(nullptr) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::exception();
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(BundleHeader)) {
+        close(fd);
+        throw std::exception();
+    }
+    size = st.st_size;
+
+    // 启动时一次性读入全部页面，之后发送时不会在反应堆线程上缺页
+    void* addr = mmap(0, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::exception();
+    }
+    base = (char*)addr;
+
+    // 校验头部和各区域的范围
+    header = (const BundleHeader*)base;
+    bool ok = memcmp(header->magic, BUNDLE_MAGIC, sizeof(header->magic)) == 0 && header->version == BUNDLE_VERSION &&
+              header->size == size && header->slotCount > 0 && (header->slotCount & (header->slotCount - 1)) == 0 &&
+              header->slotsOffset + (uint64_t)header->slotCount * sizeof(uint32_t) <= size &&
+              header->entriesOffset + (uint64_t)header->count * sizeof(BundleEntry) <= size;
+    if (ok) {
+        slots = (const uint32_t*)(base + header->slotsOffset);
+        entries = (const BundleEntry*)(base + header->entriesOffset);
+        for (uint32_t i = 0; i < header->count && ok; i++) {
+            const BundleEntry& e = entries[i];
+            ok = e.pathOffset + e.pathLen <= size && memchr(e.lastModified, '\0', sizeof(e.lastModified));
+            for (int enc = 0; enc < BUNDLE_ENCODINGS && ok; enc++) {
+                ok = e.bodyOffset[enc] + e.bodyLen[enc] <= size && e.headerOffset[enc][0] + e.headerLen[enc][0] <= size &&
+                     e.headerOffset[enc][1] + e.headerLen[enc][1] <= size && memchr(e.etag[enc], '\0', sizeof(e.etag[enc]));
+            }
+        }
+    }
+    if (!ok) {
+        munmap(base, size);
+        throw std::exception();
+    }
+}
+
+Bundle::~Bundle() {
+    munmap(base, size);
+}
+
+// 线性探测查找
+const BundleEntry* Bundle::find(const char* path) const {
+    size_t len = strlen(path);
+    uint64_t hash = bundleHash(path, len);
+    uint32_t mask = header->slotCount - 1;
+    for (uint32_t i = hash & mask, n = 0; n < header->slotCount; i = (i + 1) & mask, n++) {
+        uint32_t slot = slots[i];
+        if (slot == 0 || slot > header->count) {
+            return nullptr;
+        }
+        const BundleEntry& e = entries[slot - 1];
+        if (e.hash == hash && e.pathLen == len && memcmp(base + e.pathOffset, path, len) == 0) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
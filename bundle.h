@@ -0,0 +1,96 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 静态资源包：由tools/bundlePack在构建时把网站根目录打包成一个带索引的文件，服务器启动时整个映射到内存
+// 文件布局：BundleHeader | 哈希槽 | BundleEntry数组 | 路径、预先生成的头部和文件内容
+// 所有偏移都相对于文件开头，整数按本机字节序存放，打包和服务需在同一种机器上
+
+// 文件开头的魔数和格式版本
+#define BUNDLE_MAGIC "TWSBNDL1"
+static const uint32_t BUNDLE_VERSION = 2;
+
+// 内容编码，每个文件至少有原始内容，可压缩的文本文件还可以有gzip版本
+enum BUNDLE_ENCODING {
+    BUNDLE_IDENTITY = 0,
+    BUNDLE_GZIP,
+    BUNDLE_ENCODINGS
+};
+
+struct BundleHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;         // 文件数
+    uint32_t slotCount;     // 哈希槽数，2的幂
+    uint32_t reserved;
+    uint64_t slotsOffset;   // uint32_t[slotCount]，值为条目下标加一，0表示空槽
+    uint64_t entriesOffset; // BundleEntry[count]
+    uint64_t size;          // 整个文件的大小
+};
+
+struct BundleEntry {
+    // 请求路径的哈希及路径本身，如"/images/image1.jpg"
+    uint64_t hash;
+    uint64_t pathOffset;
+    uint64_t pathLen;
+
+    // 各编码的内容，长度为0的非原始编码表示没有该版本
+    uint64_t bodyOffset[BUNDLE_ENCODINGS];
+    uint64_t bodyLen[BUNDLE_ENCODINGS];
+
+    // 打包时文件的修改时间，以及条件请求使用的Last-Modified和各编码的ETag，都以空字符结尾
+    int64_t mtime;
+    char lastModified[32];
+    char etag[BUNDLE_ENCODINGS][24];
+
+    // 预先生成的从状态行到空行的完整头部，第二维为0表示保持连接、1表示关闭连接
+    uint64_t headerOffset[BUNDLE_ENCODINGS][2];
+    uint64_t headerLen[BUNDLE_ENCODINGS][2];
+};
+
+// 路径的哈希，FNV-1a，打包和查找使用同一个函数
+inline uint64_t bundleHash(const char* path, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)path[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// 映射到内存的资源包，只读，可被多个线程同时查找
+class Bundle {
+public:
+    // 打开并映射整个资源包，预读全部页面，格式不对时抛出异常
+    explicit Bundle(const char* path);
+    ~Bundle();
+
+    Bundle(const Bundle&) = delete;
+    Bundle& operator=(const Bundle&) = delete;
+
+    // 按请求路径查找，没有时返回nullptr，不需要任何系统调用
+    const BundleEntry* find(const char* path) const;
+
+    // 偏移处的数据
+    const char* at(uint64_t offset) const {
+        return base + offset;
+    }
+
+    // 文件数和资源包的大小
+    uint32_t count() const {
+        return header->count;
+    }
+    size_t bytes() const {
+        return size;
+    }
+
+private:
+    char* base;
+    size_t size;
+    const BundleHeader* header;
+    const uint32_t* slots;
+    const BundleEntry* entries;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef CODEL_H
+#define CODEL_H
+
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include "locker.h"
+
+// CoDel（Controlled Delay）丢弃策略，根据请求在队列中的停留时间决定是否丢弃
+// 停留时间持续一个interval都超过target后进入丢弃状态，丢弃的间隔按interval/sqrt(count)逐渐缩短，
+// 停留时间回落到target以下后退出丢弃状态。短暂的突发不会触发丢弃，持续的过载使排队延迟维持在target附近
+class CoDel {
+public:
+    // 构造函数，target为0表示不丢弃
+    CoDel(uint64_t _targetNs, uint64_t _intervalNs) :
+        targetNs(_targetNs), intervalNs(_intervalNs), locker("codel"),
+        firstAboveTime(0), dropNext(0), count(0), dropping(false), dropped(0) {}
+
+    // 请求出队时调用，sojournNs为其在队列中的停留时间，返回是否丢弃该请求
+    bool shouldDrop(uint64_t now, uint64_t sojournNs);
+
+    // 是否启用
+    bool enabled() const {
+        return targetNs != 0;
+    }
+
+    // 丢弃的请求总数
+    unsigned long droppedCount() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    // 下一次丢弃的时间
+    uint64_t controlLaw(uint64_t t) const {
+        return t + (uint64_t)(intervalNs / sqrt((double)count));
+    }
+
+private:
+    // 目标停留时间和观察窗口
+    uint64_t targetNs;
+    uint64_t intervalNs;
+
+    // 以下状态由多个工作线程共享，停留时间正常时只读不加锁
+    Locker locker;
+
+    // 停留时间首次超过target后再过一个interval的时刻，0表示未超过
+    std::atomic<uint64_t> firstAboveTime;
+
+    // 丢弃状态下下一次丢弃的时刻和本轮已丢弃的个数
+    uint64_t dropNext;
+    unsigned count;
+    std::atomic<bool> dropping;
+
+    // 丢弃的请求总数
+    std::atomic<unsigned long> dropped;
+};
+
+// 请求出队时调用，返回是否丢弃该请求
+inline bool CoDel::shouldDrop(uint64_t now, uint64_t sojournNs) {
+    if (!enabled()) {
+        return false;
+    }
+
+    // 快速路径：停留时间正常且不在丢弃状态
+    if (sojournNs < targetNs && !dropping.load(std::memory_order_relaxed)) {
+        if (firstAboveTime.load(std::memory_order_relaxed) != 0) {
+            firstAboveTime.store(0, std::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    locker.lock();
+
+    // 停留时间是否已持续一个interval超过target
+    bool okToDrop = false;
+    if (sojournNs < targetNs) {
+        firstAboveTime.store(0, std::memory_order_relaxed);
+    } else if (firstAboveTime.load(std::memory_order_relaxed) == 0) {
+        firstAboveTime.store(now + intervalNs, std::memory_order_relaxed);
+    } else if (now >= firstAboveTime.load(std::memory_order_relaxed)) {
+        okToDrop = true;
+    }
+
+    bool drop = false;
+    if (dropping.load(std::memory_order_relaxed)) {
+        if (!okToDrop) {
+            // 延迟已回落，退出丢弃状态
+            dropping.store(false, std::memory_order_relaxed);
+        } else if (now >= dropNext) {
+            drop = true;
+            count++;
+            dropNext = controlLaw(dropNext);
+        }
+    } else if (okToDrop) {
+        // 进入丢弃状态，距上一轮不久时沿用上一轮的丢弃频率
+        drop = true;
+        dropping.store(true, std::memory_order_relaxed);
+        count = (count > 2 && now - dropNext < 8 * intervalNs) ? count - 2 : 1;
+        dropNext = controlLaw(now);
+    }
+
+    locker.unlock();
+
+    if (drop) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    return drop;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include <string.h>
+#include <zlib.h>
+#include <brotli/encode.h>
+#include "compression.h"
+
+// 编码名和后缀
+static const char* const encodingNames[ENCODINGS] = {"identity", "gzip", "br"};
+static const char* const encodingSuffixes[ENCODINGS] = {"", ".gz", ".br"};
+
+const char* encodingName(CONTENT_ENCODING encoding) {
+    return encodingNames[encoding];
+}
+
+const char* encodingSuffix(CONTENT_ENCODING encoding) {
+    return encodingSuffixes[encoding];
+}
+
+// 文本类型才压缩
+bool compressible(const char* mimeType) {
+    return strncmp(mimeType, "text/", 5) == 0 || strcmp(mimeType, "application/javascript") == 0 ||
+           strcmp(mimeType, "application/json") == 0 || strcmp(mimeType, "application/xml") == 0 ||
+           strcmp(mimeType, "image/svg+xml") == 0;
+}
+
+// gzip格式，zlib的最高压缩级别
+static bool gzipCompress(const char* data, size_t len, std::string& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&zs, len) + 32);
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = len;
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+// brotli的质量取9，比最高的11快一个数量级，压缩率相差不多
+static bool brotliCompress(const char* data, size_t len, std::string& out) {
+    size_t outLen = BrotliEncoderMaxCompressedSize(len);
+    if (outLen == 0) {
+        return false;
+    }
+    out.resize(outLen);
+    if (!BrotliEncoderCompress(9, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len, (const uint8_t*)data, &outLen,
+                               (uint8_t*)&out[0])) {
+        return false;
+    }
+    out.resize(outLen);
+    return true;
+}
+
+// 压缩
+bool compress(CONTENT_ENCODING encoding, const char* data, size_t len, std::string& out) {
+    switch (encoding) {
+        case ENCODING_GZIP:
+            return gzipCompress(data, len, out);
+        case ENCODING_BR:
+            return brotliCompress(data, len, out);
+        default:
+            return false;
+    }
+}
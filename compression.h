@@ -0,0 +1,27 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stddef.h>
+#include <string>
+
+// 响应的内容编码，按优先级从低到高排列，协商时从后往前选择客户端接受的编码
+enum CONTENT_ENCODING {
+    ENCODING_IDENTITY = 0,
+    ENCODING_GZIP,
+    ENCODING_BR,
+    ENCODINGS
+};
+
+// Accept-Encoding和Content-Encoding中的编码名，如"gzip"
+const char* encodingName(CONTENT_ENCODING encoding);
+
+// 预压缩的同名文件的后缀，如".gz"
+const char* encodingSuffix(CONTENT_ENCODING encoding);
+
+// 该MIME类型的内容是否值得压缩，图片、字体、视频等已经是压缩格式
+bool compressible(const char* mimeType);
+
+// 以较高的压缩级别一次性压缩整块数据，结果只生成一次、反复发送，失败时返回false
+bool compress(CONTENT_ENCODING encoding, const char* data, size_t len, std::string& out);
+
+#endif
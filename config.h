@@ -0,0 +1,92 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// I/O后端
+enum IO_BACKEND {
+    IO_EPOLL = 0,   // epoll + recv/writev
+    IO_URING        // io_uring，多发accept、多发recv配合提供缓冲区环
+};
+
+// 线程绑定CPU的策略
+enum AFFINITY_POLICY {
+    AFFINITY_NONE = 0,  // 不绑定，由调度器决定
+    AFFINITY_COMPACT,   // 紧凑，先占满一个NUMA节点，同一物理核的超线程相邻
+    AFFINITY_SCATTER,   // 分散，在各NUMA节点和物理核之间轮流
+    AFFINITY_LIST       // 按给定的CPU列表依次绑定
+};
+
+// 文件内容的发送方式
+enum FILE_SEND {
+    SEND_MMAP = 0,  // mmap后与头部一起writev
+    SEND_SENDFILE,  // 头部带MSG_MORE发送，文件用sendfile从页缓存发送
+    SEND_SPLICE     // 头部带MSG_MORE发送，文件经管道splice到socket
+};
+
+// 服务器的运行参数，由命令行解析得到
+struct ServerConfig {
+    // 监听端口
+    int port = 0;
+
+    // 反应堆个数，为1时只在主线程运行一个事件循环
+    int reactorNums = 1;
+
+    // 监听队列长度，内核会将其截断为net.core.somaxconn
+    int backlog = 1024;
+
+    // 监听socket每次可读时最多接受的连接数，避免新连接风暴饿死已有连接
+    int acceptBudget = 64;
+
+    // 最大的连接数，连接对象按需分配，不再受fd大小的限制
+    int maxConns = 65536;
+
+    // 反应堆使用的I/O后端
+    IO_BACKEND ioBackend = IO_EPOLL;
+
+    // 线程池线程数的上下限，0表示下限取CPU核数、上限取下限的4倍
+    int minThreads = 0;
+    int maxThreads = 0;
+
+    // 线程池请求队列的容量，0表示取线程数上限的1024倍
+    int maxRequests = 0;
+
+    // 线程池是否开启工作窃取，开启后同一连接的请求尽量由同一工作线程处理
+    bool workStealing = false;
+
+    // 反应堆和工作线程绑定CPU的策略，AFFINITY_LIST时使用cpuList
+    AFFINITY_POLICY affinity = AFFINITY_NONE;
+    const char* cpuList = nullptr;
+
+    // 请求排队时间的目标值，单位为毫秒，排队时间持续超过它时工作线程直接回复503，为0时不丢弃
+    int shedTargetMs = 5;
+
+    // 不小于fileSendThreshold字节的文件按fileSend方式发送，更小的文件mmap后与头部一起writev，io_uring后端总是使用mmap
+    // 映射随文件缓存的条目保留，不再每个请求都mmap，流水线中的多个响应合并为一次writev，比逐个sendfile快
+    FILE_SEND fileSend = SEND_SENDFILE;
+    long fileSendThreshold = 1024 * 1024;
+
+    // 文件缓存最多保持打开的文件数，按分片数向上取整，为0时每次请求都重新打开
+    int fileCacheSize = 4096;
+
+    // 不大于renderLimit字节的文件缓存预先渲染好的完整响应，总共最多占用renderBudget字节，renderLimit为负时不渲染
+    long renderLimit = 16 * 1024;
+    long renderBudget = 64L * 1024 * 1024;
+
+    // 没有预压缩的.br/.gz文件时，不大于compressLimit字节的文本文件在后台压缩一次，压缩结果总共最多占用compressBudget字节
+    // compressLimit为负时不压缩，只使用预压缩的文件
+    long compressLimit = 1024 * 1024;
+    long compressBudget = 64L * 1024 * 1024;
+
+    // 预读冷文件的I/O线程数，为0时不预读，缺页和磁盘读取发生在反应堆线程的发送中
+    int ioThreads = 2;
+
+    // 启动时预热文件缓存的总字节数，为0时不预热，文件在第一次被请求时才打开和读入
+    long preloadBytes = 0;
+
+    // 网站根目录，nullptr表示使用默认目录
+    const char* docRoot = nullptr;
+
+    // 由tools/bundlePack打包的静态资源包，不为nullptr时所有请求都从中服务，不再访问网站根目录
+    const char* bundlePath = nullptr;
+};
+
+#endif
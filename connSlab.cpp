@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <new>
+#include "connSlab.h"
+#include "httpConn.h"
+#include "affinity.h"
+
+ConnSlab::ConnSlab() : locker("conn slab"), node(-1), inUse(0), peakInUse(0) {
+}
+
+// 析构函数
+ConnSlab::~ConnSlab() {
+    for (size_t i = 0; i < chunks.size(); i++) {
+        for (int j = 0; j < CHUNK_SIZE; j++) {
+            chunks[i][j].~HTTPConn();
+        }
+        freeOnNode(chunks[i], sizeof(HTTPConn) * CHUNK_SIZE);
+    }
+}
+
+// 分配连接对象，空闲链表为空时再分配一块
+HTTPConn* ConnSlab::acquire(int fd) {
+    locker.lock();
+    if (freeConns.empty()) {
+        // 块直接从内核分配，在反应堆所在的节点上，或由反应堆线程首次访问时决定
+        HTTPConn* chunk = (HTTPConn*)allocOnNode(sizeof(HTTPConn) * CHUNK_SIZE, node);
+        for (int i = 0; i < CHUNK_SIZE; i++) {
+            new (chunk + i) HTTPConn();
+        }
+        chunks.push_back(chunk);
+
+        // 倒序压入，使低地址的对象先被使用
+        for (int i = CHUNK_SIZE - 1; i >= 0; i--) {
+            freeConns.push_back(chunk + i);
+        }
+    }
+    HTTPConn* conn = freeConns.back();
+    freeConns.pop_back();
+
+    // 映射表按两倍增长，get()只在反应堆线程中调用，不会与这里的增长并发
+    if ((size_t)fd >= table.size()) {
+        table.resize(fd * 2 + 1, nullptr);
+    }
+    table[fd] = conn;
+
+    inUse++;
+    if (inUse > peakInUse) {
+        peakInUse = inUse;
+    }
+    locker.unlock();
+    return conn;
+}
+
+// 归还连接对象，调用者需保证此后不再访问该对象
+void ConnSlab::release(int fd) {
+    locker.lock();
+    if ((size_t)fd < table.size() && table[fd]) {
+        freeConns.push_back(table[fd]);
+        table[fd] = nullptr;
+        inUse--;
+    }
+    locker.unlock();
+}
+
+// 打印当前和峰值的占用情况
+void ConnSlab::printStats() {
+    locker.lock();
+    size_t objects = chunks.size() * CHUNK_SIZE;
+    printf("    conns in use %zu, peak %zu, slab %zu objects in %zu chunks (%zu KB), fd table %zu entries\n",
+           inUse, peakInUse, objects, chunks.size(), objects * sizeof(HTTPConn) / 1024, table.size());
+    locker.unlock();
+}
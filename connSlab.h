@@ -0,0 +1,60 @@
+#ifndef CONNSLAB_H
+#define CONNSLAB_H
+
+#include <stddef.h>
+#include <vector>
+#include "locker.h"
+
+class HTTPConn;
+
+// 连接对象的slab分配器，按块增长，释放的对象挂到空闲链表上复用
+// 每个反应堆拥有一个，fd到连接对象的映射表也随最大的fd增长，不再受固定数组大小的限制
+class ConnSlab {
+public:
+    // 每次增长分配的连接对象个数
+    static const int CHUNK_SIZE = 256;
+
+    ConnSlab();
+
+    // 设置分配块时偏好的NUMA节点，-1表示由首次访问的线程决定
+    void setNode(int _node) {
+        node = _node;
+    }
+
+    // 析构函数，释放所有的块
+    ~ConnSlab();
+
+    // 为新接受的fd分配一个连接对象，只由所属的反应堆线程调用
+    HTTPConn* acquire(int fd);
+
+    // 查找fd对应的连接对象，没有则返回nullptr，只由所属的反应堆线程调用
+    HTTPConn* get(int fd) {
+        return (size_t)fd < table.size() ? table[fd] : nullptr;
+    }
+
+    // 归还fd对应的连接对象，可由任意线程调用
+    void release(int fd);
+
+    // 打印当前和峰值的占用情况
+    void printStats();
+
+private:
+    // 保护空闲链表、映射表的增长和统计信息
+    Locker locker;
+
+    // 已分配的块，块在node上分配
+    std::vector<HTTPConn*> chunks;
+    int node;
+
+    // 空闲的连接对象
+    std::vector<HTTPConn*> freeConns;
+
+    // fd到连接对象的映射表
+    std::vector<HTTPConn*> table;
+
+    // 正在使用的连接对象个数及其峰值
+    size_t inUse;
+    size_t peakInUse;
+};
+
+#endif
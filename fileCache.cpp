@@ -0,0 +1,775 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include "fileCache.h"
+
+// 扩展名与MIME类型
+static const struct {
+    const char* ext;
+    const char* type;
+} mimeTypes[] = {
+    {"html", "text/html"}, {"htm", "text/html"}, {"css", "text/css"}, {"js", "application/javascript"},
+    {"json", "application/json"}, {"txt", "text/plain"}, {"xml", "application/xml"},
+    {"jpg", "image/jpeg"}, {"jpeg", "image/jpeg"}, {"png", "image/png"}, {"gif", "image/gif"},
+    {"svg", "image/svg+xml"}, {"ico", "image/x-icon"}, {"webp", "image/webp"},
+    {"woff", "font/woff"}, {"woff2", "font/woff2"}, {"mp4", "video/mp4"}, {"pdf", "application/pdf"},
+};
+
+// 根据扩展名得到MIME类型
+const char* mimeType(const char* path) {
+    const char* slash = strrchr(path, '/');
+    const char* dot = strrchr(path, '.');
+    if (dot && (!slash || dot > slash)) {
+        for (size_t i = 0; i < sizeof(mimeTypes) / sizeof(mimeTypes[0]); i++) {
+            if (strcasecmp(dot + 1, mimeTypes[i].ext) == 0) {
+                return mimeTypes[i].type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+// FNV-1a
+static uint64_t hashPath(const char* path, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)path[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// 生成校验器
+void makeValidators(const struct stat& st, Validators& validators) {
+    validators.mtime = st.st_mtime;
+    struct tm tm;
+    gmtime_r(&st.st_mtime, &tm);
+    strftime(validators.lastModified, sizeof(validators.lastModified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    uint64_t fields[4] = {(uint64_t)st.st_ino, (uint64_t)st.st_size, (uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec};
+    uint64_t h = hashPath((const char*)fields, sizeof(fields));
+    for (int i = 0; i < ENCODINGS; i++) {
+        const char* suffix = encodingSuffix((CONTENT_ENCODING)i);
+        snprintf(validators.etags[i], sizeof(validators.etags[i]), "\"%016llx%s%s\"", (unsigned long long)h,
+                 *suffix ? "-" : "", *suffix ? suffix + 1 : "");
+    }
+}
+
+// 只缓存规范的路径，含"//"或以'.'开头的段的路径与inotify报告的文件名对不上，无法失效
+static bool cacheablePath(const char* path) {
+    return path[0] == '/' && !strstr(path, "//") && !strstr(path, "/.");
+}
+
+// 路径中是否有".."段，这样的路径可能指向根目录之外，无论是否缓存都不打开
+static bool hasDotDot(const char* path) {
+    for (const char* p = path; (p = strstr(p, "..")) != nullptr; p += 2) {
+        if ((p == path || p[-1] == '/') && (p[2] == '\0' || p[2] == '/')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+
+// 文件变化时需要使条目失效的事件
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                   IN_DELETE_SELF | IN_MOVE_SELF;
+
+// 构造函数
+FileCache::FileCache(const char* _root, int _capacity, off_t _mapThreshold, off_t _renderLimit, size_t _renderBudget,
+                     off_t _compressLimit, size_t _compressBudget)
+    : root(_root), capacity(_capacity), mapThreshold(_mapThreshold), renderLimit(_renderLimit), renderBudget(_renderBudget),
+      renderedBytes(0), renderHits(0), renderMisses(0), renderOverBudget(0), compressLimit(_compressLimit),
+      compressBudget(_compressBudget), compressedBytes(0), variantHits(0), siblingVariants(0), compressions(0),
+      compressInBytes(0), compressOverBudget(0), prefaults(0), prefaultBytes(0), inotifyFd(-1), stopFd(-1), watchLock("file watch") {
+    shardCapacity = (capacity + SHARDS - 1) / SHARDS;
+
+    // 桶数取不小于每片容量的2的幂
+    size_t buckets = 1;
+    while (buckets < (size_t)shardCapacity) {
+        buckets <<= 1;
+    }
+    for (int i = 0; i < SHARDS; i++) {
+        shards[i].buckets.assign(buckets, nullptr);
+    }
+    if (capacity <= 0) {
+        return;
+    }
+
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotifyFd < 0 || stopFd < 0 || pthread_create(&watchThread, nullptr, watcher, this) != 0) {
+        if (inotifyFd >= 0) {
+            close(inotifyFd);
+        }
+        if (stopFd >= 0) {
+            close(stopFd);
+        }
+        throw std::exception();
+    }
+}
+
+// 析构函数
+FileCache::~FileCache() {
+    if (stopFd >= 0) {
+        uint64_t one = 1;
+        ssize_t n = ::write(stopFd, &one, sizeof(one));
+        (void)n;
+        pthread_join(watchThread, nullptr);
+        close(stopFd);
+        close(inotifyFd);
+    }
+    for (int i = 0; i < SHARDS; i++) {
+        while (shards[i].lruHead) {
+            Entry* entry = shards[i].lruHead;
+            unlink(shards[i], entry);
+            release(entry);
+        }
+    }
+}
+
+// 获取文件
+FILE_STATUS FileCache::acquire(const char* path, Entry*& entry) {
+    if (hasDotDot(path)) {
+        return FILE_FORBIDDEN;
+    }
+    size_t len = strlen(path);
+    uint64_t hash = hashPath(path, len);
+    Shard& shard = shards[hash & (SHARDS - 1)];
+    bool cacheable = capacity > 0 && cacheablePath(path);
+
+    uint64_t generation = 0;
+    if (cacheable) {
+        shard.locker.lock();
+        Entry* found = find(shard, path, len, hash);
+        if (found) {
+            touch(shard, found);
+            found->refs.fetch_add(1, std::memory_order_relaxed);
+            shard.hits.store(shard.hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            shard.locker.unlock();
+            entry = found;
+            return FILE_OK;
+        }
+        generation = shard.generation;
+        shard.misses.store(shard.misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        shard.locker.unlock();
+
+        // 先监视目录再打开文件，打开之后的变化一定会产生事件
+        // 无法监视时条目不能失效，这次的结果只给本次请求使用
+        cacheable = watch(path);
+    }
+
+    FILE_STATUS status = openFile(path, hash, entry);
+    if (status != FILE_OK || !cacheable) {
+        return status;
+    }
+
+    Entry* victim = nullptr;
+    shard.locker.lock();
+    if (shard.generation != generation) {
+        // 打开期间有文件变化，这次的结果只给本次请求使用
+        shard.locker.unlock();
+        return FILE_OK;
+    }
+    Entry* found = find(shard, path, len, hash);
+    if (found) {
+        // 其他线程已经放入缓存，使用已有的条目
+        touch(shard, found);
+        found->refs.fetch_add(1, std::memory_order_relaxed);
+        shard.locker.unlock();
+        release(entry);
+        entry = found;
+        return FILE_OK;
+    }
+    entry->refs.fetch_add(1, std::memory_order_relaxed);
+    link(shard, entry);
+    if (shard.count > shardCapacity) {
+        victim = shard.lruTail;
+        unlink(shard, victim);
+        shard.evictions.store(shard.evictions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    shard.locker.unlock();
+
+    // 在锁外关闭被淘汰的文件
+    if (victim) {
+        release(victim);
+    }
+    return FILE_OK;
+}
+
+// 释放一个引用
+void FileCache::release(Entry* entry) {
+    if (entry->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (entry->map) {
+        munmap(entry->map, entry->st.st_size);
+    }
+    Rendered* rendered = entry->rendered.load(std::memory_order_relaxed);
+    if (rendered) {
+        entry->owner->renderedBytes.fetch_sub(rendered->keepAliveLen + rendered->closeLen, std::memory_order_relaxed);
+        delete [] rendered->data;
+        delete rendered;
+    }
+    for (int i = ENCODINGS - 1; i > ENCODING_IDENTITY; i--) {
+        Variant* variant = entry->variants[i];
+        if (!variant) {
+            continue;
+        }
+        if (variant->sibling) {
+            release(variant->sibling);
+        } else {
+            entry->owner->compressedBytes.fetch_sub(variant->len, std::memory_order_relaxed);
+            delete [] variant->data;
+        }
+        delete variant;
+    }
+    close(entry->fd);
+    delete entry;
+}
+
+// 逐页读一个字节，用于不支持MADV_POPULATE_READ的内核
+static void touchPages(const char* p, size_t len) {
+    static const long pageSize = sysconf(_SC_PAGESIZE);
+    volatile char sink = 0;
+    for (size_t i = 0; i < len; i += pageSize) {
+        sink = sink + p[i];
+    }
+    (void)sink;
+}
+
+// 把[from, to)读入页缓存
+void FileCache::prefault(Entry* entry, off_t from, off_t to) {
+    static const long pageSize = sysconf(_SC_PAGESIZE);
+    if (from >= to) {
+        return;
+    }
+    prefaults.fetch_add(1, std::memory_order_relaxed);
+    prefaultBytes.fetch_add(to - from, std::memory_order_relaxed);
+
+    // 映射的起点按页对齐
+    off_t start = from & ~(off_t)(pageSize - 1);
+    size_t len = to - start;
+    if (entry->map) {
+        if (madvise(entry->map + start, len, MADV_POPULATE_READ) < 0) {
+            touchPages(entry->map + start, len);
+        }
+        return;
+    }
+
+    // sendfile和splice发送的文件没有映射，临时映射这一段，读入页缓存后解除
+    void* addr = mmap(0, len, PROT_READ, MAP_SHARED, entry->fd, start);
+    if (addr == MAP_FAILED) {
+        return;
+    }
+    if (madvise(addr, len, MADV_POPULATE_READ) < 0) {
+        touchPages((const char*)addr, len);
+    }
+    munmap(addr, len);
+}
+
+// 获取预先渲染好的响应
+const FileCache::Rendered* FileCache::rendered(Entry* entry) {
+    Rendered* rendered = entry->rendered.load(std::memory_order_acquire);
+    if (rendered) {
+        renderHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        renderMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+    return rendered;
+}
+
+// 挂上渲染好的响应
+bool FileCache::attach(Entry* entry, Rendered* rendered) {
+    size_t size = rendered->keepAliveLen + rendered->closeLen;
+    bool ok = true;
+    if (renderedBytes.fetch_add(size, std::memory_order_relaxed) + size > renderBudget) {
+        renderOverBudget.fetch_add(1, std::memory_order_relaxed);
+        ok = false;
+    } else {
+        Rendered* expected = nullptr;
+        ok = entry->rendered.compare_exchange_strong(expected, rendered, std::memory_order_release, std::memory_order_relaxed);
+    }
+    if (!ok) {
+        renderedBytes.fetch_sub(size, std::memory_order_relaxed);
+        delete [] rendered->data;
+        delete rendered;
+    }
+    return ok;
+}
+
+// 获取压缩版本
+const FileCache::Variant* FileCache::variant(Entry* entry, CONTENT_ENCODING encoding, bool& build) {
+    build = false;
+    std::atomic<int>& state = entry->variantState[encoding];
+    int current = state.load(std::memory_order_acquire);
+    if (current == VARIANT_READY) {
+        variantHits.fetch_add(1, std::memory_order_relaxed);
+        return entry->variants[encoding];
+    }
+    if (current != VARIANT_UNKNOWN || !state.compare_exchange_strong(current, VARIANT_PENDING, std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    // 预压缩的同名文件也经过缓存，之后它的变化会使这个条目一起失效，比原文件旧的不使用
+    Entry* sibling = nullptr;
+    std::string path = entry->path + encodingSuffix(encoding);
+    if (acquire(path.c_str(), sibling) == FILE_OK) {
+        if (sibling->st.st_size > 0 && sibling->st.st_mtime >= entry->st.st_mtime) {
+            entry->variants[encoding] = new Variant{sibling, nullptr, 0};
+            state.store(VARIANT_READY, std::memory_order_release);
+            siblingVariants.fetch_add(1, std::memory_order_relaxed);
+            return entry->variants[encoding];
+        }
+        release(sibling);
+    }
+
+    if (entry->st.st_size >= MIN_COMPRESS && entry->st.st_size <= compressLimit &&
+        compressedBytes.load(std::memory_order_relaxed) < compressBudget) {
+        build = true;
+    } else {
+        state.store(VARIANT_NONE, std::memory_order_release);
+    }
+    return nullptr;
+}
+
+// 压缩整个文件
+void FileCache::buildVariant(Entry* entry, CONTENT_ENCODING encoding) {
+    const off_t size = entry->st.st_size;
+    std::string data, packed;
+    const char* in = entry->map;
+    if (!in) {
+        data.resize(size);
+        off_t done = 0;
+        while (done < size) {
+            ssize_t n = pread(entry->fd, &data[done], size - done, done);
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        in = done == size ? data.data() : nullptr;
+    }
+
+    // 压缩后不小于原大小的90%时不值得协商，以后一直发送原始内容
+    Variant* variant = nullptr;
+    if (in && compress(encoding, in, size, packed) && packed.size() * 10 < (size_t)size * 9) {
+        compressions.fetch_add(1, std::memory_order_relaxed);
+        compressInBytes.fetch_add(size, std::memory_order_relaxed);
+        if (compressedBytes.fetch_add(packed.size(), std::memory_order_relaxed) + packed.size() > compressBudget) {
+            compressedBytes.fetch_sub(packed.size(), std::memory_order_relaxed);
+            compressOverBudget.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            variant = new Variant{nullptr, new char[packed.size()], packed.size()};
+            memcpy(variant->data, packed.data(), packed.size());
+        }
+    }
+    entry->variants[encoding] = variant;
+    entry->variantState[encoding].store(variant ? VARIANT_READY : VARIANT_NONE, std::memory_order_release);
+}
+
+// 打开文件
+FILE_STATUS FileCache::openFile(const char* path, uint64_t hash, Entry*& entry) {
+    char fullPath[PATH_MAX];
+    if (snprintf(fullPath, sizeof(fullPath), "%s%s", root.c_str(), path) >= (int)sizeof(fullPath)) {
+        return FILE_NOT_FOUND;
+    }
+
+    // O_NONBLOCK防止打开命名管道时阻塞，对普通文件的读取没有影响
+    int fd = open(fullPath, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == EACCES ? FILE_FORBIDDEN : FILE_NOT_FOUND;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return FILE_ERROR;
+    }
+
+    // 判断访问权限和文件类型
+    FILE_STATUS status = FILE_OK;
+    if (!(st.st_mode & S_IROTH)) {
+        status = FILE_FORBIDDEN;
+    } else if (S_ISDIR(st.st_mode)) {
+        status = FILE_IS_DIR;
+    } else if (!S_ISREG(st.st_mode)) {
+        status = FILE_FORBIDDEN;
+    }
+    if (status != FILE_OK) {
+        close(fd);
+        return status;
+    }
+
+    char* map = nullptr;
+    if (st.st_size > 0 && st.st_size < mapThreshold) {
+        void* addr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            return FILE_ERROR;
+        }
+        map = (char*)addr;
+    }
+
+    entry = new Entry;
+    entry->path = path;
+    entry->hash = hash;
+    entry->fd = fd;
+    entry->st = st;
+    entry->mimeType = mimeType(path);
+    makeValidators(st, entry->validators);
+    entry->map = map;
+    entry->refs.store(1, std::memory_order_relaxed);
+    entry->warm.store(false, std::memory_order_relaxed);
+    entry->rendered.store(nullptr, std::memory_order_relaxed);
+    for (int i = 0; i < ENCODINGS; i++) {
+        entry->variantState[i].store(VARIANT_UNKNOWN, std::memory_order_relaxed);
+        entry->variants[i] = nullptr;
+    }
+    entry->owner = this;
+    entry->hashNext = entry->prev = entry->next = nullptr;
+    return FILE_OK;
+}
+
+// 查找条目
+FileCache::Entry* FileCache::find(Shard& shard, const char* path, size_t len, uint64_t hash) {
+    Entry* entry = shard.buckets[(hash / SHARDS) & (shard.buckets.size() - 1)];
+    while (entry && !(entry->hash == hash && entry->path.size() == len && memcmp(entry->path.data(), path, len) == 0)) {
+        entry = entry->hashNext;
+    }
+    return entry;
+}
+
+// 加入哈希表，放在LRU链表头部
+void FileCache::link(Shard& shard, Entry* entry) {
+    Entry*& bucket = shard.buckets[(entry->hash / SHARDS) & (shard.buckets.size() - 1)];
+    entry->hashNext = bucket;
+    bucket = entry;
+
+    entry->prev = nullptr;
+    entry->next = shard.lruHead;
+    if (shard.lruHead) {
+        shard.lruHead->prev = entry;
+    } else {
+        shard.lruTail = entry;
+    }
+    shard.lruHead = entry;
+    shard.count++;
+}
+
+// 移出哈希表和LRU链表，缓存持有的引用交给调用者释放
+void FileCache::unlink(Shard& shard, Entry* entry) {
+    Entry** p = &shard.buckets[(entry->hash / SHARDS) & (shard.buckets.size() - 1)];
+    while (*p != entry) {
+        p = &(*p)->hashNext;
+    }
+    *p = entry->hashNext;
+
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        shard.lruHead = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        shard.lruTail = entry->prev;
+    }
+    shard.count--;
+}
+
+// 移到LRU链表头部
+void FileCache::touch(Shard& shard, Entry* entry) {
+    if (shard.lruHead == entry) {
+        return;
+    }
+    entry->prev->next = entry->next;
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        shard.lruTail = entry->prev;
+    }
+    entry->prev = nullptr;
+    entry->next = shard.lruHead;
+    shard.lruHead->prev = entry;
+    shard.lruHead = entry;
+}
+
+// 监视路径所在的目录
+bool FileCache::watch(const char* path) {
+    std::string dir(path, strrchr(path, '/') - path);
+    bool watched = true;
+    watchLock.lock();
+    if (watchedDirs.find(dir) == watchedDirs.end()) {
+        int wd = inotify_add_watch(inotifyFd, (root + dir).c_str(), WATCH_MASK | IN_ONLYDIR);
+        watched = wd >= 0;
+        if (watched) {
+            // 同一目录以另一个路径被监视过时inotify返回相同的wd，以新的路径为准
+            std::unordered_map<int, std::string>::iterator it = watchPaths.find(wd);
+            if (it != watchPaths.end()) {
+                watchedDirs.erase(it->second);
+            }
+            watchedDirs[dir] = wd;
+            watchPaths[wd] = dir;
+        }
+    }
+    watchLock.unlock();
+    return watched;
+}
+
+// 移除一个条目
+void FileCache::invalidate(const std::string& path) {
+    uint64_t hash = hashPath(path.data(), path.size());
+    Shard& shard = shards[hash & (SHARDS - 1)];
+    shard.locker.lock();
+    shard.generation++;
+    Entry* entry = find(shard, path.data(), path.size(), hash);
+    if (entry) {
+        unlink(shard, entry);
+        shard.invalidations.store(shard.invalidations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    shard.locker.unlock();
+    if (entry) {
+        release(entry);
+    }
+}
+
+// 移除所有条目
+void FileCache::invalidateAll() {
+    for (int i = 0; i < SHARDS; i++) {
+        Shard& shard = shards[i];
+        shard.locker.lock();
+        shard.generation++;
+        Entry* list = shard.lruHead;
+        unsigned long n = shard.count;
+        shard.buckets.assign(shard.buckets.size(), nullptr);
+        shard.lruHead = shard.lruTail = nullptr;
+        shard.count = 0;
+        shard.invalidations.store(shard.invalidations.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        shard.locker.unlock();
+        while (list) {
+            Entry* next = list->next;
+            release(list);
+            list = next;
+        }
+    }
+}
+
+// 处理inotify事件
+void FileCache::handleEvents() {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        ssize_t n = read(inotifyFd, buf, sizeof(buf));
+        if (n <= 0) {
+            return;
+        }
+        for (char* p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len) {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // 丢失了事件，不知道哪些文件变了
+                invalidateAll();
+                continue;
+            }
+
+            watchLock.lock();
+            std::unordered_map<int, std::string>::iterator it = watchPaths.find(event->wd);
+            std::string dir = it == watchPaths.end() ? std::string() : it->second;
+            bool known = it != watchPaths.end();
+            if (known && (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))) {
+                // 目录已被删除或移动，原来的路径不再对应这个目录，解除监视，下次缓存该路径下的文件时重新监视
+                if (!(event->mask & IN_IGNORED)) {
+                    inotify_rm_watch(inotifyFd, event->wd);
+                }
+                watchedDirs.erase(it->second);
+                watchPaths.erase(it);
+            }
+            watchLock.unlock();
+            if (!known) {
+                continue;
+            }
+
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                invalidateAll();
+            } else if (event->len > 0) {
+                if (event->mask & IN_ISDIR) {
+                    // 子目录被移动或删除，其下所有路径都可能已失效
+                    invalidateAll();
+                } else {
+                    invalidate(dir + "/" + event->name);
+
+                    // 预压缩的同名文件变化时，挂着它的原文件的条目也要失效
+                    size_t len = strlen(event->name);
+                    for (int i = ENCODINGS - 1; i > ENCODING_IDENTITY; i--) {
+                        size_t suffixLen = strlen(encodingSuffix((CONTENT_ENCODING)i));
+                        if (len > suffixLen && strcmp(event->name + len - suffixLen, encodingSuffix((CONTENT_ENCODING)i)) == 0) {
+                            invalidate(dir + "/" + std::string(event->name, len - suffixLen));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// 监视线程，等待inotify事件或退出通知
+void* FileCache::watcher(void* arg) {
+    FileCache* cache = (FileCache*)arg;
+    struct pollfd fds[2];
+    fds[0].fd = cache->inotifyFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = cache->stopFd;
+    fds[1].events = POLLIN;
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (fds[0].revents) {
+            cache->handleEvents();
+        }
+    }
+    return cache;
+}
+
+// 列出目录下的所有普通文件
+void FileCache::listFiles(const std::string& dir, std::vector<std::pair<off_t, std::string>>& out) {
+    DIR* d = opendir((root + dir).c_str());
+    if (!d) {
+        return;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        std::string path = dir + "/" + ent->d_name;
+        struct stat st;
+        if (stat((root + path).c_str(), &st) < 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            listFiles(path, out);
+        } else if (S_ISREG(st.st_mode) && (st.st_mode & S_IROTH)) {
+            out.push_back(std::make_pair(st.st_size, path));
+        }
+    }
+    closedir(d);
+}
+
+// 预热线程
+void* FileCache::preloader(void* arg) {
+    PreloadJob* job = (PreloadJob*)arg;
+    static const off_t LARGE_FILE = 2 << 20;
+    size_t i;
+    while ((i = job->next.fetch_add(1)) < job->files->size()) {
+        Entry* entry;
+        if (job->cache->acquire((*job->files)[i].second.c_str(), entry) != FILE_OK) {
+            continue;
+        }
+
+        // 大文件先让内核对整个文件发起预读，随后的MADV_POPULATE_READ多半直接命中页缓存，不必逐段等待磁盘
+        if (entry->st.st_size >= LARGE_FILE) {
+            posix_fadvise(entry->fd, 0, entry->st.st_size, POSIX_FADV_WILLNEED);
+        }
+        job->cache->prefault(entry, 0, entry->st.st_size);
+        entry->warm.store(true, std::memory_order_relaxed);
+        job->loaded.fetch_add(1);
+        release(entry);
+    }
+    return job;
+}
+
+// 启动时预热
+int FileCache::preload(uint64_t maxBytes, int threads, uint64_t& bytes) {
+    bytes = 0;
+    if (capacity <= 0) {
+        return 0;
+    }
+    std::vector<std::pair<off_t, std::string>> files;
+    listFiles("", files);
+
+    // 小文件通常是最热的页面和资源，先预热，总大小不超过限制
+    // 淘汰按分片进行，每个分片最多预热shardCapacity个文件，否则哈希不均匀时刚预热的文件会被挤出，分片满了就跳过落在其中的文件
+    std::sort(files.begin(), files.end());
+    int perShard[SHARDS] = {};
+    size_t n = 0;
+    for (size_t i = 0; i < files.size() && bytes + files[i].first <= maxBytes; i++) {
+        const std::string& path = files[i].second;
+        int& count = perShard[hashPath(path.data(), path.size()) & (SHARDS - 1)];
+        if (count >= shardCapacity) {
+            continue;
+        }
+        count++;
+        bytes += files[i].first;
+        files[n++] = files[i];
+    }
+    files.resize(n);
+
+    PreloadJob job;
+    job.cache = this;
+    job.files = &files;
+    job.next = 0;
+    job.loaded = 0;
+    std::vector<pthread_t> tids;
+    for (int i = 0; i < threads - 1; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, nullptr, preloader, &job) == 0) {
+            tids.push_back(tid);
+        }
+    }
+    preloader(&job);
+    for (size_t i = 0; i < tids.size(); i++) {
+        pthread_join(tids[i], nullptr);
+    }
+    return job.loaded.load();
+}
+
+// 打印统计信息
+void FileCache::printStats() {
+    unsigned long hits = 0, misses = 0, evictions = 0, invalidations = 0;
+    int entries = 0;
+    for (int i = 0; i < SHARDS; i++) {
+        hits += shards[i].hits.load(std::memory_order_relaxed);
+        misses += shards[i].misses.load(std::memory_order_relaxed);
+        evictions += shards[i].evictions.load(std::memory_order_relaxed);
+        invalidations += shards[i].invalidations.load(std::memory_order_relaxed);
+        entries += shards[i].count;
+    }
+    watchLock.lock();
+    size_t dirs = watchedDirs.size();
+    watchLock.unlock();
+    printf("file cache: %d/%d files, hits %lu, misses %lu (%.2f%% hit), evictions %lu, invalidations %lu, %zu dirs watched\n",
+           entries, shardCapacity * SHARDS, hits, misses, hits + misses ? hits * 100.0 / (hits + misses) : 0.0,
+           evictions, invalidations, dirs);
+    printf("    prefetched %.1f MB off the reactor in %lu reads\n",
+           prefaultBytes.load(std::memory_order_relaxed) / 1048576.0, prefaults.load(std::memory_order_relaxed));
+    if (renderLimit >= 0) {
+        unsigned long rHits = renderHits.load(std::memory_order_relaxed);
+        unsigned long rMisses = renderMisses.load(std::memory_order_relaxed);
+        printf("    rendered responses for files <= %ld bytes: %.1f/%zu KB, hits %lu, misses %lu (%.2f%% hit), over budget %lu\n",
+               (long)renderLimit, renderedBytes.load(std::memory_order_relaxed) / 1024.0, renderBudget / 1024, rHits, rMisses,
+               rHits + rMisses ? rHits * 100.0 / (rHits + rMisses) : 0.0, renderOverBudget.load(std::memory_order_relaxed));
+    }
+    printf("    compressed variants: %lu hits, %lu precompressed siblings, %lu compressed (%.1f KB -> %.1f/%zu KB), over budget %lu\n",
+           variantHits.load(std::memory_order_relaxed), siblingVariants.load(std::memory_order_relaxed),
+           compressions.load(std::memory_order_relaxed), compressInBytes.load(std::memory_order_relaxed) / 1024.0,
+           compressedBytes.load(std::memory_order_relaxed) / 1024.0, compressBudget / 1024,
+           compressOverBudget.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,273 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "locker.h"
+#include "compression.h"
+
+// 查找文件的结果
+enum FILE_STATUS {
+    FILE_OK = 0,
+    FILE_NOT_FOUND,     // 不存在或无法打开
+    FILE_FORBIDDEN,     // 其他用户不可读，或不是普通文件
+    FILE_IS_DIR,        // 是目录
+    FILE_ERROR          // 映射失败等内部错误
+};
+
+// 根据扩展名得到文件的MIME类型，未知的扩展名按二进制数据处理
+const char* mimeType(const char* path);
+
+// 一个文件版本的校验器，Last-Modified的日期和各编码的ETag，都已带上格式，可以直接写入头部
+// ETag是inode、大小和纳秒级修改时间的哈希，文件变化后不同，各编码的ETag带不同后缀，如"5e1f0c3a9b2d4e67-br"
+struct Validators {
+    time_t mtime;
+    char lastModified[32];
+    char etags[ENCODINGS][24];
+};
+
+// 由文件的元数据生成校验器
+void makeValidators(const struct stat& st, Validators& validators);
+
+// 打开的文件及其元数据的缓存，以请求路径为键，按路径的哈希分片，每片有自己的锁、哈希表和LRU链表
+// 缓存过文件的目录都用inotify监视，其中的文件被修改、删除、移动或改变权限后，对应的条目由监视线程立即移除
+// 命中时只在分片锁内查表并调整LRU，不需要任何文件系统的系统调用
+// 小文件的条目上还可以挂一份预先渲染好的完整响应，条目失效时随之释放
+// 文本文件的条目上还可以挂各编码的压缩版本，优先使用同目录下预压缩的.br/.gz文件，没有时在后台压缩一次
+class FileCache {
+public:
+    // 分片数，必须是2的幂
+    static const int SHARDS = 16;
+
+    // 预先渲染好的完整响应，状态行、头部和内容连续存放，保持连接和关闭连接的两个版本依次排列
+    struct Rendered {
+        char* data;
+        size_t keepAliveLen;
+        size_t closeLen;
+    };
+
+    // 压缩版本的状态，由第一个请求该编码的线程从UNKNOWN改为PENDING，查找或压缩完成后改为READY或NONE
+    enum VARIANT_STATE {
+        VARIANT_UNKNOWN = 0,
+        VARIANT_PENDING,
+        VARIANT_READY,
+        VARIANT_NONE
+    };
+
+    // 一个压缩版本，sibling为预压缩的同名文件的条目，持有一个引用，否则为压缩好的内存
+    struct Entry;
+    struct Variant {
+        Entry* sibling;
+        char* data;
+        size_t len;
+    };
+
+    // 一个打开的文件，由引用计数管理，缓存持有一个引用，每个正在使用它的响应各持有一个引用
+    // 失效或被淘汰的条目从缓存中移除，已排队的响应仍可以继续发送，最后一个引用释放时关闭
+    struct Entry {
+        std::string path;
+        uint64_t hash;
+        int fd;
+        struct stat st;
+        const char* mimeType;
+
+        // 打开时生成一次的校验器，条目随文件的变化失效，所以一直与打开的版本对应
+        Validators validators;
+
+        // 小于映射阈值的非空文件的只读映射，否则为nullptr
+        char* map;
+
+        std::atomic<int> refs;
+
+        // 整个文件都已预读到页缓存中，发送时不再检查
+        std::atomic<bool> warm;
+
+        // 预先渲染好的响应，第一次以小文件发送时生成，此后只读
+        std::atomic<Rendered*> rendered;
+
+        // 各编码的压缩版本，variantState为VARIANT_READY之后variants才可以读取，此后只读
+        std::atomic<int> variantState[ENCODINGS];
+        Variant* variants[ENCODINGS];
+
+        // 所属的缓存，释放渲染的响应时归还内存预算
+        FileCache* owner;
+
+        // 所在哈希桶的下一个条目
+        Entry* hashNext;
+
+        // LRU链表，prev方向是更近使用的条目
+        Entry* prev;
+        Entry* next;
+    };
+
+    // 小于该字节数的文件不压缩，压缩节省的流量抵不上Vary和解压的开销
+    static const off_t MIN_COMPRESS = 256;
+
+    // root为网站根目录，capacity为最多缓存的文件数，为0时不缓存，每次请求都重新打开
+    // 小于mapThreshold字节的非空文件在打开时映射到内存，其余的由sendfile或splice发送
+    // 不大于renderLimit字节的文件预先渲染完整的响应，渲染的响应总共最多占用renderBudget字节，renderLimit为负时不渲染
+    // 没有预压缩文件时，不大于compressLimit字节的文本文件压缩后缓存，总共最多占用compressBudget字节，compressLimit为负时不压缩
+    // 创建inotify实例或监视线程失败时抛出异常
+    FileCache(const char* root, int capacity, off_t mapThreshold, off_t renderLimit, size_t renderBudget,
+              off_t compressLimit, size_t compressBudget);
+    ~FileCache();
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    // 获取请求路径path对应的文件，返回FILE_OK时entry带有一个引用，用完后调用release()
+    // 含".."段的路径返回FILE_FORBIDDEN
+    FILE_STATUS acquire(const char* path, Entry*& entry);
+
+    // 释放一个引用，最后一个引用释放时解除映射并关闭文件
+    static void release(Entry* entry);
+
+    // 增加一个引用，用于把条目交给另一个响应或后台任务
+    static Entry* retain(Entry* entry) {
+        entry->refs.fetch_add(1, std::memory_order_relaxed);
+        return entry;
+    }
+
+    // 把文件的[from, to)读入页缓存，有映射时同时建立页表项，由I/O线程或工作线程调用，可能阻塞
+    // 页面可能之后被回收，这里只保证读完时在内存中
+    void prefault(Entry* entry, off_t from, off_t to);
+
+    // 文件是否小到需要预先渲染响应，内存预算用完后不再渲染
+    bool renderable(const Entry* entry) const {
+        return capacity > 0 && entry->st.st_size <= renderLimit &&
+               renderedBytes.load(std::memory_order_relaxed) < renderBudget;
+    }
+
+    // 获取条目上预先渲染好的响应，没有时返回nullptr，由调用者渲染后调用attach()
+    const Rendered* rendered(Entry* entry);
+
+    // 把渲染好的响应挂到条目上，之后由缓存负责释放，超出内存预算或已有其他线程挂上时释放rendered并返回false
+    bool attach(Entry* entry, Rendered* rendered);
+
+    // 文件是否按Accept-Encoding协商编码，这样的文件的所有响应都带Vary: Accept-Encoding
+    bool negotiable(const Entry* entry) const {
+        return capacity > 0 && compressible(entry->mimeType);
+    }
+
+    // 获取条目的encoding编码版本，还没有时返回nullptr，由调用者发送原始内容
+    // 第一次请求时查找预压缩的同名文件，没有且值得压缩时build为true，调用者应在后台调用buildVariant()
+    const Variant* variant(Entry* entry, CONTENT_ENCODING encoding, bool& build);
+
+    // 读取并压缩整个文件，挂到条目上，可能耗时较长，由I/O线程或工作线程调用
+    void buildVariant(Entry* entry, CONTENT_ENCODING encoding);
+
+    // 启动时预热：遍历根目录，按从小到大的顺序打开文件放入缓存并整个读入内存，
+    // 直到总大小超过maxBytes或缓存已满，2MB以上的文件先整体发起预读，由threads个线程并行读取
+    // 返回预热的文件数，bytes为其总大小
+    int preload(uint64_t maxBytes, int threads, uint64_t& bytes);
+
+    // 打印命中率等统计信息
+    void printStats();
+
+private:
+    struct alignas(64) Shard {
+        Shard() : locker("file cache"), lruHead(nullptr), lruTail(nullptr), count(0), generation(0),
+                  hits(0), misses(0), evictions(0), invalidations(0) {}
+
+        Locker locker;
+        std::vector<Entry*> buckets;
+        Entry* lruHead;
+        Entry* lruTail;
+        int count;
+
+        // 每次移除失效条目时加一，未命中后打开文件期间若有变化，打开的结果可能已过时，不放入缓存
+        uint64_t generation;
+
+        // 统计，持有锁时更新
+        std::atomic<unsigned long> hits;
+        std::atomic<unsigned long> misses;
+        std::atomic<unsigned long> evictions;
+        std::atomic<unsigned long> invalidations;
+    };
+
+    // 打开文件并创建不在缓存中的条目，引用计数为1
+    FILE_STATUS openFile(const char* path, uint64_t hash, Entry*& entry);
+
+    // 在分片中查找，调用者持有分片的锁
+    Entry* find(Shard& shard, const char* path, size_t len, uint64_t hash);
+
+    // 把条目加入或移出分片的哈希表和LRU链表，调用者持有分片的锁
+    void link(Shard& shard, Entry* entry);
+    void unlink(Shard& shard, Entry* entry);
+
+    // 移到LRU链表头部
+    void touch(Shard& shard, Entry* entry);
+
+    // 监视路径所在的目录，之后其中的文件变化会使缓存的条目失效，返回目录是否在监视中
+    bool watch(const char* path);
+
+    // 移除path对应的条目
+    void invalidate(const std::string& path);
+
+    // 移除所有条目，用于目录被移动或删除、事件队列溢出等无法逐个定位的情况
+    void invalidateAll();
+
+    // 读取并处理inotify事件
+    void handleEvents();
+
+    // 监视线程
+    static void* watcher(void* arg);
+
+    // 递归列出目录dir（相对于根目录）下的所有普通文件及其大小，跳过以'.'开头的名字
+    void listFiles(const std::string& dir, std::vector<std::pair<off_t, std::string>>& out);
+
+    // 预热线程，依次取出待预热的文件
+    struct PreloadJob {
+        FileCache* cache;
+        const std::vector<std::pair<off_t, std::string>>* files;
+        std::atomic<size_t> next;
+        std::atomic<int> loaded;
+    };
+    static void* preloader(void* arg);
+
+    std::string root;
+    int capacity;
+    int shardCapacity;
+    off_t mapThreshold;
+
+    // 预先渲染的响应的大小上限、内存预算、已占用的内存和统计
+    off_t renderLimit;
+    size_t renderBudget;
+    std::atomic<size_t> renderedBytes;
+    std::atomic<unsigned long> renderHits;
+    std::atomic<unsigned long> renderMisses;
+    std::atomic<unsigned long> renderOverBudget;
+
+    // 压缩的大小上限、内存预算、已占用的内存和统计
+    off_t compressLimit;
+    size_t compressBudget;
+    std::atomic<size_t> compressedBytes;
+    std::atomic<unsigned long> variantHits;
+    std::atomic<unsigned long> siblingVariants;
+    std::atomic<unsigned long> compressions;
+    std::atomic<uint64_t> compressInBytes;
+    std::atomic<unsigned long> compressOverBudget;
+
+    // 预读的次数和字节数
+    std::atomic<unsigned long> prefaults;
+    std::atomic<uint64_t> prefaultBytes;
+    Shard shards[SHARDS];
+
+    // inotify实例，以及用于通知监视线程退出的eventfd
+    int inotifyFd;
+    int stopFd;
+    pthread_t watchThread;
+
+    // 已监视的目录，键为相对于根目录的路径，根目录为空串
+    Locker watchLock;
+    std::unordered_map<std::string, int> watchedDirs;
+    std::unordered_map<int, std::string> watchPaths;
+};
+
+#endif
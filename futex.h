@@ -0,0 +1,84 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// 自旋等待时提示CPU降低功耗并让出流水线
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// 单调时钟的当前时间，单位为纳秒
+inline uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 若*addr仍等于expected则休眠，直到被唤醒、超时或被信号中断，timeout为nullptr表示不超时
+inline int futexWait(std::atomic<uint32_t>* addr, uint32_t expected, const struct timespec* timeout = nullptr) {
+    return syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+// 唤醒最多n个在addr上休眠的线程
+inline int futexWake(std::atomic<uint32_t>* addr, int n) {
+    return syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+}
+
+// 事件计数器，用于空闲线程的休眠与唤醒
+// 等待方：prepareWait()后再检查一次条件，条件仍不满足才wait()，否则cancelWait()
+// 通知方：先使条件成立，再notify()，没有等待者时不产生系统调用
+class EventCount {
+public:
+    EventCount() : epoch(0), waiters(0) {}
+
+    // 登记为等待者，返回当前的纪元
+    uint32_t prepareWait() {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_seq_cst);
+    }
+
+    // 条件已满足，取消等待
+    void cancelWait() {
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    // 纪元仍为key时休眠
+    void wait(uint32_t key) {
+        while (epoch.load(std::memory_order_acquire) == key) {
+            futexWait(&epoch, key);
+        }
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    // 唤醒最多n个等待者，返回是否有等待者
+    bool notify(int n) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) == 0) {
+            return false;
+        }
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        futexWake(&epoch, n);
+        return true;
+    }
+
+    // 唤醒所有等待者
+    void notifyAll() {
+        notify(0x7fffffff);
+    }
+
+private:
+    std::atomic<uint32_t> epoch;
+    std::atomic<int> waiters;
+};
+
+#endif
@@ -1,7 +1,12 @@
 #include "httpConn.h"
+#include "reactor.h"
+#include "connSlab.h"
+#include "httpScanner.h"
+#include "threadpool.h"
 
 // 定义HTTP响应的一些状态信息
 const char* ok_200_title = "OK";
+const char* not_modified_304_title = "Not Modified";
 const char* error_400_title = "Bad Request";
 const char* error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
 const char* error_403_title = "Forbidden";
@@ -10,19 +15,23 @@ const char* error_404_title = "Not Found";
 const char* error_404_form = "The requested file was not found on this server.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+const char* error_503_title = "Service Unavailable";
+const char* error_503_form = "The server is overloaded, please try again later.\n";
+
+// 线程池队列已满时由反应堆直接发送的完整响应
+static const char busyResponse[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 50\r\n"
+    "Content-Type:text/html\r\n"
+    "Connection: close\r\n"
+    "Retry-After: 1\r\n"
+    "\r\n"
+    "The server is overloaded, please try again later.\n";
 
 // 网站的根目录
 const char* docRoot = "/home/tinywebsever/resources";
 
-// 设置文件描述符为非阻塞
-int setnonblocking(int fd) {
-    int old_option = fcntl(fd, F_GETFL);
-    int new_option = old_option | O_NONBLOCK;
-    fcntl(fd, F_SETFL, new_option);
-    return old_option;
-}
-
-// 向epoll中添加需要监听的文件描述符
+// 向epoll中添加需要监听的文件描述符，fd在创建时已经是非阻塞的
 void addfd(int epollfd, int fd, bool one_shot) {
     // 创建一个epoll事件
     epoll_event event;
@@ -38,18 +47,6 @@ void addfd(int epollfd, int fd, bool one_shot) {
 
     // 向epollfd中添加fd
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-
-    // 设置文件描述符非阻塞
-    setnonblocking(fd);  
-}
-
-// 从epollfd中移除监听的fd
-void removefd(int epollfd, int fd) {
-    // 从epollfd中移除监听的fd
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
-
-    // 关闭fd
-    close(fd);
 }
 
 // 修改文件描述符，重置socket上的EPOLLONESHOT事件，以确保下一次可读时，EPOLLIN事件能被触发
@@ -64,34 +61,58 @@ void modfd(int epollfd, int fd, int ev) {
 }
 
 // 所有的客户数
-int HTTPConn::userCount = 0;
+std::atomic<int> HTTPConn::userCount(0);
+
+// 文件内容的发送方式
+FILE_SEND HTTPConn::fileSend = SEND_SENDFILE;
 
-// 所有socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态的
-int HTTPConn::epollFd = -1;
+// 打开的文件的缓存
+FileCache* HTTPConn::fileCache = nullptr;
+
+// 预读冷文件的I/O线程池
+ThreadPool<HTTPConn>* HTTPConn::ioPool = nullptr;
+
+// 静态资源包
+Bundle* HTTPConn::bundle = nullptr;
 
 // 关闭连接
 void HTTPConn::closeConn() {
     if(socketFd != -1) {
-        // 将socket从epoll中移除
-        removefd(epollFd, socketFd);
+        int fd = socketFd;
         socketFd = -1;
+        unmap();
+        output.release();
+        releaseBuffer();
+
+        if (ringReactor) {
+            // io_uring后端先shutdown，使内核中挂起的多发recv结束
+            shutdown(fd, SHUT_RDWR);
+        } else {
+            // 将socket从epoll中移除
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, 0);
+        }
 
         // 关闭一个连接，将客户总数量减一
         userCount--; 
+
+        // 先归还连接对象再关闭fd，避免fd被重新接受后新连接的映射被清除，此后不能再访问成员
+        slab->release(fd);
+        close(fd);
     }
 }
 
 // 初始化连接,外部调用初始化套接字地址
-void HTTPConn::init(int socketfd, const sockaddr_in& addr){
+void HTTPConn::init(int socketfd, const sockaddr_in& addr, ConnSlab* owner, int epollfd, Reactor* ring){
     socketFd = socketfd;
     address = addr;
-    
-    // 端口复用
-    int reuse = 1;
-    setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    slab = owner;
+    epollFd = epollfd;
+    ringReactor = ring;
 
-    // 将fd添加epoll监听
-    addfd(epollFd, socketfd, true );
+    // 将fd添加epoll监听，io_uring后端由反应堆提交recv请求
+    if (!ringReactor) {
+        addfd(epollFd, socketfd, true );
+    }
 
     // 用户数加一
     userCount++;
@@ -101,6 +122,23 @@ void HTTPConn::init(int socketfd, const sockaddr_in& addr){
 
 // 默认初始化连接
 void HTTPConn::init()
+{
+    resetRequest();
+    startLine = 0;
+    checkedIndex = 0;
+    readIndex = 0;
+    writeIndex = 0;
+    responseCount = 0;
+    output.clear();
+    closeAfterWrite = false;
+    pipelineFull = false;
+
+    // 连接空闲，归还缓冲区，解析只访问已读入的数据，无需清零
+    releaseBuffer();
+}
+
+// 重置单个请求的解析状态
+void HTTPConn::resetRequest()
 {
     // 初始状态为检查请求行
     checkState = CHECK_STATE_REQUESTLINE;    
@@ -114,15 +152,42 @@ void HTTPConn::init()
     httpVersion = 0;
     contentLength = 0;
     hostName = 0;
+    headers.clear();
+}
+
+// 准备解析流水线中的下一个请求
+void HTTPConn::nextRequest() {
+    // 带消息体的请求到消息体的结尾为止
+    int consumed = checkedIndex;
+    if (checkState == CHECK_STATE_CONTENT) {
+        consumed += (int)contentLength;
+    }
+
+    // 响应已生成，不再引用读缓冲区中的数据，可以移动
+    readIndex -= consumed;
+    memmove(readBuffer, readBuffer + consumed, readIndex);
     startLine = 0;
     checkedIndex = 0;
-    readIndex = 0;
-    writeIndex = 0;
+    resetRequest();
+}
 
-    // 缓冲区清零
-    bzero(readBuffer, READ_BUFFER_SIZE);
-    bzero(writeBuffer, READ_BUFFER_SIZE);
-    bzero(realFile, FILENAME_LEN);
+// 借用读写缓冲区
+void HTTPConn::attachBuffer() {
+    if (!ioBuffer) {
+        ioBuffer = IOBufferPool::acquire();
+        readBuffer = ioBuffer;
+        writeBuffer = ioBuffer + READ_BUFFER_SIZE;
+    }
+}
+
+// 归还读写缓冲区
+void HTTPConn::releaseBuffer() {
+    if (ioBuffer) {
+        IOBufferPool::release(ioBuffer);
+        ioBuffer = nullptr;
+        readBuffer = nullptr;
+        writeBuffer = nullptr;
+    }
 }
 
 // 循环读取客户数据，直到无数据可读或者对方关闭连接
@@ -130,6 +195,7 @@ bool HTTPConn::read() {
     if(readIndex >= READ_BUFFER_SIZE) {
         return false;
     }
+    attachBuffer();
     int bytesRead = 0;
 
     // 循环读取数据
@@ -148,69 +214,91 @@ bool HTTPConn::read() {
         }
         readIndex += bytesRead;
     }
+
+    // 没有读到数据，不必占用缓冲区
+    if (readIndex == 0) {
+        releaseBuffer();
+    }
     return true;
 }
 
-// 解析一行，判断依据\r\n
+// 把io_uring已收到的数据追加到读缓冲区
+bool HTTPConn::receive(const char* data, int len) {
+    if (len > READ_BUFFER_SIZE - readIndex) {
+        return false;
+    }
+    attachBuffer();
+    memcpy(readBuffer + readIndex, data, len);
+    readIndex += len;
+    return true;
+}
+
+// 解析一行，判断依据\r\n，用向量化扫描跳过行内的普通字符
 HTTPConn::LINE_STATUS HTTPConn::parseLine() {
-    char temp;
-    for (; checkedIndex < readIndex; checkedIndex++) {
-        temp = readBuffer[checkedIndex];
-        if (temp == '\r') {
-            if ((checkedIndex + 1) == readIndex ) {
-                return LINE_OPEN;
-            } else if (readBuffer[checkedIndex + 1] == '\n' ) {
-                readBuffer[checkedIndex++] = '\0';
-                readBuffer[checkedIndex++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        } else if( temp == '\n' )  {
-            if((checkedIndex > 1) && (readBuffer[checkedIndex - 1] == '\r' ) ) {
-                readBuffer[checkedIndex - 1] = '\0';
-                readBuffer[checkedIndex++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+    if (checkedIndex >= readIndex) {
+        return LINE_OPEN;
+    }
+    checkedIndex = scanLineEnd(readBuffer + checkedIndex, readBuffer + readIndex) - readBuffer;
+    if (checkedIndex == readIndex) {
+        return LINE_OPEN;
+    }
+    if (readBuffer[checkedIndex] == '\r') {
+        if ((checkedIndex + 1) == readIndex) {
+            // 停在\r上，收到后续数据时从这里继续
+            return LINE_OPEN;
+        } else if (readBuffer[checkedIndex + 1] == '\n') {
+            readBuffer[checkedIndex++] = '\0';
+            readBuffer[checkedIndex++] = '\0';
+            return LINE_OK;
         }
+        return LINE_BAD;
     }
-    return LINE_OPEN;
+    // 单独的\n
+    if ((checkedIndex > 1) && (readBuffer[checkedIndex - 1] == '\r')) {
+        readBuffer[checkedIndex - 1] = '\0';
+        readBuffer[checkedIndex++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
 }
 
-// 解析HTTP请求行，获得请求方法，目标URL,以及HTTP版本号
-HTTPConn::HTTP_CODE HTTPConn::parseRequestLine(char* text) {
+// 解析HTTP请求行，获得请求方法，目标URL,以及HTTP版本号，len为行的长度
+HTTPConn::HTTP_CODE HTTPConn::parseRequestLine(char* text, int len) {
     // GET /index.html HTTP/1.1
-    url = strpbrk(text, " \t"); // 判断第二个参数中的字符哪个在text中最先出现
-    if (!url) { 
+    char* end = text + len;
+    url = (char*)scanDelims(text, end, " \t", 2);
+    if (url == end) {
         return BAD_REQUEST;
     }
 
     // GET\0/index.html HTTP/1.1
     // 置位空字符，字符串结束符
-    *url++ = '\0';    
+    int methodLen = url - text;
+    *url++ = '\0';
 
-    char* method = text;
-    if (strcasecmp(method, "GET") == 0) { 
+    if (methodLen == 3 && strncasecmp(text, "GET", 3) == 0) {
         // 忽略大小写比较
         httpMethod = GET;
+    } else if (methodLen == 4 && strncasecmp(text, "HEAD", 4) == 0) {
+        // 与GET的响应相同，只是不发送内容
+        httpMethod = HEAD;
     } else {
         return BAD_REQUEST;
     }
 
     // /index.html HTTP/1.1
-    // 检索字符串 str1 中第一个不在字符串 str2 中出现的字符下标。
-    httpVersion = strpbrk(url, " \t");
-    if (!httpVersion) {
+    httpVersion = (char*)scanDelims(url, end, " \t", 2);
+    if (httpVersion == end) {
         return BAD_REQUEST;
     }
     *httpVersion++ = '\0';
-    if (strcasecmp(httpVersion, "HTTP/1.1") != 0) {
+    if (end - httpVersion != 8 || strncasecmp(httpVersion, "HTTP/1.1", 8) != 0) {
         return BAD_REQUEST;
     }
 
-    if (strncasecmp(url, "http://", 7) == 0 ) {   
+    if (strncasecmp(url, "http://", 7) == 0 ) {
         url += 7;
-        // 在参数 str 所指向的字符串中搜索第一次出现字符 c（一个无符号字符）的位置。
+        // 跳过主机名，找到路径的开头
         url = strchr(url, '/');
     }
     if (!url || url[0] != '/' ) {
@@ -218,14 +306,33 @@ HTTPConn::HTTP_CODE HTTPConn::parseRequestLine(char* text) {
     }
 
     // 检查状态变成检查头
-    checkState = CHECK_STATE_HEADER; 
+    checkState = CHECK_STATE_HEADER;
     return NO_REQUEST;
 }
 
-// 解析HTTP请求的一个头部信息
-HTTPConn::HTTP_CODE HTTPConn::parseHeaders(char* text) {   
+// 解析HTTP请求的一个头部信息，len为行的长度
+HTTPConn::HTTP_CODE HTTPConn::parseHeaders(char* text, int len) {
     // 遇到空行，表示头部字段解析完毕
-    if(text[0] == '\0') {
+    if(len == 0) {
+        // 头部已完整，取出处理请求需要的字段，先确定消息的边界，边界不明确时不保持连接
+        // 不支持分块等传输编码，带Transfer-Encoding的请求（无论是否同时带Content-Length）无法确定消息体在哪里结束，一律拒绝
+        if (headers.has(HEADER_TRANSFER_ENCODING)) {
+            return BAD_REQUEST;
+        }
+        off_t length;
+        if (!headers.contentLength(length)) {
+            return BAD_REQUEST;
+        }
+
+        // 消息体必须能和头部一起放进读缓冲区，否则永远读不完整，之后计算流水线中下一个请求的位置也会越界
+        if (length > READ_BUFFER_SIZE - checkedIndex) {
+            return BAD_REQUEST;
+        }
+        contentLength = length;
+        linger = headers.keepAlive();
+        const HeaderTable::Field* host = headers.find(HEADER_HOST);
+        hostName = host ? (char*)host->value : nullptr;
+
         // 如果HTTP请求有消息体，则还需要读取m_content_length字节的消息体，
         // 状态机转移到CHECK_STATE_CONTENT状态
         if (contentLength != 0) {
@@ -235,34 +342,33 @@ HTTPConn::HTTP_CODE HTTPConn::parseHeaders(char* text) {
 
         // 否则说明我们已经得到了一个完整的HTTP请求
         return GET_REQUEST;
-    } else if (strncasecmp(text, "Connection:", 11) == 0) {
-        // 处理Connection 头部字段  Connection: keep-alive
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0) {
-            linger = true;
-        }
-    } else if (strncasecmp( text, "Content-Length:", 15) == 0) {
-        // 处理Content-Length头部字段
-        text += 15;
-        text += strspn( text, " \t" );
-        contentLength = atol(text);
-    } else if ( strncasecmp( text, "Host:", 5 ) == 0 ) {
-        // 处理Host头部字段
-        text += 5;
-        text += strspn( text, " \t" );
-        hostName = text;
-    } else {
-        printf("oop! unknow header %s\n", text);
+    }
+
+    // 字段名和值都指向读缓冲区，识别字段类型只需一次哈希和一次比较
+    char* end = text + len;
+    char* colon = (char*)scanDelims(text, end, ":", 1);
+    if (colon == end) {
+        // 没有冒号的行不是合法的字段，忽略
+        return NO_REQUEST;
+    }
+    char* value = colon + 1;
+    value += strspn(value, " \t");
+    char* valueEnd = end;
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+        valueEnd--;
+    }
+    // 字段过多时不能丢弃，被丢弃的可能正是Content-Length或Connection，请求按错误处理
+    if (!headers.add(text, colon - text, value, valueEnd - value)) {
+        return BAD_REQUEST;
     }
     return NO_REQUEST;
 }
 
 // 没有真正解析HTTP请求的消息体，只是判断它是否被完整的读入了
-HTTPConn::HTTP_CODE HTTPConn::parseContent( char* text ) {
+HTTPConn::HTTP_CODE HTTPConn::parseContent() {
+    // 不在消息体之后写结束符，消息体正好填满读缓冲区时那个位置是写缓冲区的第一个字节，可能属于已排队的响应
     if (readIndex >= (contentLength + checkedIndex))
     {
-        text[contentLength] = '\0';
         return GET_REQUEST;
     }
     return NO_REQUEST;
@@ -274,21 +380,21 @@ HTTPConn::HTTP_CODE HTTPConn::processRead() {
     HTTP_CODE ret = NO_REQUEST;
     char* text = 0;
     while (((checkState == CHECK_STATE_CONTENT) && (lineStatus == LINE_OK)) || ((lineStatus = parseLine()) == LINE_OK)) {
-        // 获取一行数据
+        // 获取一行数据，行尾的\r\n已被替换为两个\0
         text = getLine();
+        int len = checkedIndex - startLine - 2;
         startLine = checkedIndex;
-        printf("got 1 http line: %s\n", text);
 
         switch (checkState) {
             case CHECK_STATE_REQUESTLINE: {
-                ret = parseRequestLine(text);
+                ret = parseRequestLine(text, len);
                 if (ret == BAD_REQUEST) {
                     return BAD_REQUEST;
                 }
                 break;
             }
             case CHECK_STATE_HEADER: {
-                ret = parseHeaders(text);
+                ret = parseHeaders(text, len);
                 if (ret == BAD_REQUEST) {
                     return BAD_REQUEST;
                 } else if (ret == GET_REQUEST) {
@@ -297,7 +403,7 @@ HTTPConn::HTTP_CODE HTTPConn::processRead() {
                 break;
             }
             case CHECK_STATE_CONTENT: {
-                ret = parseContent(text);
+                ret = parseContent();
                 if (ret == GET_REQUEST) {
                     return doRequest();
                 }
@@ -313,57 +419,130 @@ HTTPConn::HTTP_CODE HTTPConn::processRead() {
 }
 
 
-// 对内存映射区执行munmap操作
+// 释放目标文件和排队的响应使用的文件
 void HTTPConn::unmap() {
-    if(fileAddress)
-    {
-        munmap(fileAddress, fileStat.st_size );
-        fileAddress = 0;
+    if (file) {
+        FileCache::release(file);
+        file = nullptr;
+    }
+    for (int i = 0; i < responseCount; i++) {
+        if (responses[i].file) {
+            FileCache::release(responses[i].file);
+            responses[i].file = nullptr;
+        }
     }
 }
 
 // 写HTTP响应
 bool HTTPConn::write()
 {
-    int temp = 0;
-    int bytes_have_send = 0;    // 已经发送的字节
-    int bytes_to_send = writeIndex;// 将要发送的字节writeIndex写缓冲区中待发送的字节数
-    
-    if ( bytes_to_send == 0 ) {
-        // 将要发送的字节为0，这一次响应结束。
-        modfd(epollFd, socketFd, EPOLLIN); 
+    if (output.empty()) {
+        // 没有要发送的数据，这一次响应结束。
+        modfd(epollFd, socketFd, EPOLLIN);
         init();
         return true;
     }
 
-    while(1) {
-        // 分散写
-        temp = writev(socketFd, iv, ivCount);
-        if (temp <= -1) {
-            // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
-            // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
-            if( errno == EAGAIN ) {
-                modfd(epollFd, socketFd, EPOLLOUT );
-                return true;
-            }
-            unmap();
-            return false;
+    // 接下来的文件内容还不在页缓存中，等I/O线程池预读完成后重新投递EPOLLOUT
+    if (!fileReady()) {
+        return true;
+    }
+
+    // 分散写，排队的多个响应合并发送，部分发送时记录停下的位置
+    int ret = output.flush(socketFd, WRITE_BUDGET);
+    if (ret < 0) {
+        unmap();
+        return false;
+    }
+    if (ret == 0) {
+        // 如果TCP写缓冲没有空间，或本次已发送了WRITE_BUDGET字节，则等待下一轮EPOLLOUT事件，从停下的位置继续发送，
+        // 大文件因此分多轮发出，不会让反应堆长时间只服务一个连接。
+        // 虽然在此期间，服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
+        modfd(epollFd, socketFd, EPOLLOUT);
+        return true;
+    }
+
+    // 发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接
+    if (finishWrite()) {
+        // 还有未处理的请求时由反应堆直接交给线程池，不等待新的数据
+        if (!hasBufferedRequest()) {
+            modfd(epollFd, socketFd, EPOLLIN);
         }
-        bytes_to_send -= temp;
-        bytes_have_send += temp;
-        if ( bytes_to_send <= bytes_have_send ) {
-            // 发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接
-            unmap();
-            if(linger) {
-                init();
-                modfd(epollFd, socketFd, EPOLLIN );
-                return true;
+        return true;
+    }
+    return false;
+}
+
+// 检查接下来READY_AHEAD字节中的文件内容是否已预读
+bool HTTPConn::fileReady() {
+    if (!ioPool) {
+        return true;
+    }
+    int index = -1;
+    off_t offset = 0;
+    output.visit(READY_AHEAD, [&](const struct iovec& seg, int fd, off_t segOffset) {
+        // 找出该段属于哪个响应的文件，头部、错误页面和渲染好的响应不需要预读
+        for (int i = 0; i < responseCount; i++) {
+            FileCache::Entry* f = responses[i].file;
+            if (!f || f->warm.load(std::memory_order_relaxed)) {
+                continue;
+            }
+            off_t start;
+            if (fd >= 0) {
+                if (fd != f->fd) {
+                    continue;
+                }
+                start = segOffset;
+            } else if (f->map && seg.iov_base >= f->map && (char*)seg.iov_base < f->map + f->st.st_size) {
+                start = (char*)seg.iov_base - f->map;
             } else {
-                modfd(epollFd, socketFd, EPOLLIN );
+                continue;
+            }
+            if (responses[i].readyEnd < std::min(start + READY_AHEAD, f->st.st_size)) {
+                index = i;
+                offset = start;
                 return false;
-            } 
+            }
         }
+        return true;
+    });
+    if (index < 0) {
+        return true;
     }
+
+    // 从已预读的位置接着读一个窗口，完成后由I/O线程交还给反应堆
+    Response& response = responses[index];
+    off_t from = response.readyEnd;
+    off_t to = std::min(std::max(offset, from) + PREFETCH_WINDOW, response.file->st.st_size);
+    bool posted = ioPool->post([this, index, from, to]() {
+        Response& response = responses[index];
+        fileCache->prefault(response.file, from, to);
+        response.readyEnd = to;
+        if (to == response.file->st.st_size) {
+            response.file->warm.store(true, std::memory_order_relaxed);
+        }
+        rearm(EPOLLOUT);
+    });
+
+    // 任务队列已满时不再等待，缺页发生在发送的线程中
+    return !posted;
+}
+
+// 响应发送完毕，根据HTTP请求中的Connection字段决定是否保持连接
+bool HTTPConn::finishWrite() {
+    unmap();
+    if (closeAfterWrite) {
+        return false;
+    }
+    writeIndex = 0;
+    responseCount = 0;
+    output.clear();
+
+    // 读缓冲区中没有流水线剩余的数据时归还缓冲区，空闲的长连接不占用缓冲区
+    if (readIndex == 0) {
+        releaseBuffer();
+    }
+    return true;
 }
 
 // 往写缓冲中写入待发送的数据
@@ -386,12 +565,29 @@ bool HTTPConn::addStatusLine(int status, const char* title) {
     return addResponse("%s %d %s\r\n", "HTTP/1.1", status, title);
 }
 
-bool HTTPConn::addHeaders(int content_len) {
-    return addContentLength(content_len) && addContentType() && addLinger() && addBlankLine();
+bool HTTPConn::addHeaders(off_t content_len, const char* type) {
+    return addContentLength(content_len) && addContentType(type) && addLinger() && addBlankLine();
 }
 
-bool HTTPConn::addContentLength(int content_len) {
-    return addResponse("Content-Length: %d\r\n", content_len);
+// 文件响应的头部，依次为长度、类型、编码、Vary和校验器，与资源包中预先生成的头部顺序相同
+bool HTTPConn::addFileHeaders(off_t content_len, const char* type, CONTENT_ENCODING encoding, bool vary,
+                              const Validators& validators) {
+    return addContentLength(content_len) && addContentType(type) &&
+           (encoding == ENCODING_IDENTITY || addResponse("Content-Encoding: %s\r\n", encodingName(encoding))) &&
+           (!vary || addVary()) && addValidators(validators.lastModified, validators.etags[encoding]) &&
+           addLinger() && addBlankLine();
+}
+
+bool HTTPConn::addVary() {
+    return addResponse("Vary: %s\r\n", "Accept-Encoding");
+}
+
+bool HTTPConn::addValidators(const char* lastModified, const char* etag) {
+    return addResponse("Last-Modified: %s\r\nETag: %s\r\n", lastModified, etag);
+}
+
+bool HTTPConn::addContentLength(off_t content_len) {
+    return addResponse("Content-Length: %lld\r\n", (long long)content_len);
 }
 
 bool HTTPConn::addLinger()
@@ -409,106 +605,379 @@ bool HTTPConn::addContent(const char* content)
     return addResponse("%s", content);
 }
 
-bool HTTPConn::addContentType() {
-    return addResponse("Content-Type:%s\r\n", "text/html");
+bool HTTPConn::addContentType(const char* type) {
+    return addResponse("Content-Type:%s\r\n", type);
+}
+
+// 把文件的完整响应渲染到一块连续的内存中，头部借用写缓冲区的剩余空间生成，与常规方式生成的完全相同
+FileCache::Rendered* HTTPConn::renderResponse() {
+    const off_t size = file->st.st_size;
+    int start = writeIndex;
+    bool keepAlive = linger;
+
+    // 依次生成保持连接和关闭连接的头部
+    bool vary = fileCache->negotiable(file);
+    linger = true;
+    bool ok = addStatusLine(200, ok_200_title) &&
+              addFileHeaders(size, file->mimeType, ENCODING_IDENTITY, vary, file->validators);
+    int keepAliveEnd = writeIndex;
+    linger = false;
+    ok = ok && addStatusLine(200, ok_200_title) &&
+         addFileHeaders(size, file->mimeType, ENCODING_IDENTITY, vary, file->validators);
+    int closeEnd = writeIndex;
+    linger = keepAlive;
+    writeIndex = start;
+    if (!ok) {
+        return nullptr;
+    }
+
+    FileCache::Rendered* rendered = new FileCache::Rendered;
+    rendered->keepAliveLen = keepAliveEnd - start + size;
+    rendered->closeLen = closeEnd - keepAliveEnd + size;
+    rendered->data = new char[rendered->keepAliveLen + rendered->closeLen];
+
+    // 文件内容从映射的内存复制，没有映射时用pread读取
+    char* body = rendered->data + (keepAliveEnd - start);
+    if (file->map) {
+        memcpy(body, file->map, size);
+    } else {
+        off_t done = 0;
+        while (done < size) {
+            ssize_t n = pread(file->fd, body + done, size - done, done);
+            if (n <= 0) {
+                delete [] rendered->data;
+                delete rendered;
+                return nullptr;
+            }
+            done += n;
+        }
+    }
+    char* p = rendered->data;
+    memcpy(p, writeBuffer + start, keepAliveEnd - start);
+    p += rendered->keepAliveLen;
+    memcpy(p, writeBuffer + keepAliveEnd, closeEnd - keepAliveEnd);
+    memcpy(p + (closeEnd - keepAliveEnd), body, size);
+    return rendered;
+}
+
+// 发送预先渲染好的响应，一个内存段，不需要格式化头部
+bool HTTPConn::processRendered() {
+    if (!fileCache->renderable(file)) {
+        return false;
+    }
+    const FileCache::Rendered* rendered = fileCache->rendered(file);
+    if (!rendered) {
+        FileCache::Rendered* fresh = renderResponse();
+        if (!fresh || !fileCache->attach(file, fresh)) {
+            return false;
+        }
+        rendered = fresh;
+    }
+
+    // 响应持有文件的引用，渲染的内存随条目一起释放，发送期间一直有效
+    Response& response = responses[responseCount++];
+    response.file = file;
+    response.readyEnd = 0;
+    file = nullptr;
+    if (linger) {
+        output.push(rendered->data, rendered->keepAliveLen);
+    } else {
+        output.push(rendered->data + rendered->keepAliveLen, rendered->closeLen);
+        closeAfterWrite = true;
+    }
+    return true;
+}
+
+// 条件请求的校验器是否匹配，有If-None-Match时忽略If-Modified-Since
+bool HTTPConn::notModified(const char* etag, time_t mtime, const char* lastModified) const {
+    if (headers.has(HEADER_IF_NONE_MATCH)) {
+        return headers.matchesETag(etag);
+    }
+    return headers.notModifiedSince(mtime, lastModified);
+}
+
+// 304响应只有校验器等头部，没有内容，也不需要文件
+bool HTTPConn::processNotModified(const char* lastModified, const char* etag, bool vary) {
+    int start = writeIndex;
+    if (!addStatusLine(304, not_modified_304_title) || (vary && !addVary()) || !addValidators(lastModified, etag) ||
+        !addLinger() || !addBlankLine()) {
+        return false;
+    }
+    if (file) {
+        FileCache::release(file);
+        file = nullptr;
+    }
+    Response& response = responses[responseCount++];
+    response.file = nullptr;
+    response.readyEnd = 0;
+    output.push(writeBuffer + start, writeIndex - start);
+    if (!linger) {
+        closeAfterWrite = true;
+    }
+    return true;
+}
+
+// 资源包中头部和内容相邻存放，保持连接的头部紧接在内容之前，合并为一个内存段
+bool HTTPConn::processBundle() {
+    const BundleEntry* entry = bundleEntry;
+    bundleEntry = nullptr;
+    int encoding = BUNDLE_IDENTITY;
+    if (entry->bodyLen[BUNDLE_GZIP] > 0 && headers.acceptsEncoding("gzip")) {
+        encoding = BUNDLE_GZIP;
+    }
+    if (notModified(entry->etag[encoding], entry->mtime, entry->lastModified)) {
+        return processNotModified(entry->lastModified, entry->etag[encoding], entry->bodyLen[BUNDLE_GZIP] > 0);
+    }
+    int close = linger ? 0 : 1;
+
+    Response& response = responses[responseCount++];
+    response.file = nullptr;
+    response.readyEnd = 0;
+    output.push(bundle->at(entry->headerOffset[encoding][close]), entry->headerLen[encoding][close]);
+    if (httpMethod != HEAD) {
+        output.push(bundle->at(entry->bodyOffset[encoding]), entry->bodyLen[encoding]);
+    }
+    if (!linger) {
+        closeAfterWrite = true;
+    }
+    return true;
+}
+
+// 选择编码，优先br，其次gzip
+const FileCache::Variant* HTTPConn::negotiate(CONTENT_ENCODING& encoding) {
+    encoding = ENCODING_IDENTITY;
+    if (!headers.has(HEADER_ACCEPT_ENCODING) || !fileCache->negotiable(file)) {
+        return nullptr;
+    }
+    for (int i = ENCODINGS - 1; i > ENCODING_IDENTITY; i--) {
+        CONTENT_ENCODING candidate = (CONTENT_ENCODING)i;
+        if (!headers.acceptsEncoding(encodingName(candidate))) {
+            continue;
+        }
+        bool build = false;
+        const FileCache::Variant* variant = fileCache->variant(file, candidate, build);
+        if (build) {
+            // 后台任务持有文件的引用，压缩完成前本次及之后的请求先发送其他编码
+            FileCache::Entry* entry = FileCache::retain(file);
+            auto job = [entry, candidate]() {
+                fileCache->buildVariant(entry, candidate);
+                FileCache::release(entry);
+            };
+            if (!ioPool || !ioPool->post(job)) {
+                job();
+                variant = fileCache->variant(file, candidate, build);
+            }
+        }
+        if (variant) {
+            encoding = candidate;
+            return variant;
+        }
+    }
+    return nullptr;
 }
 
 // 根据服务器处理HTTP请求的结果，决定返回给客户端的内容
 bool HTTPConn::processWrite(HTTP_CODE ret) {
+    if (ret == FILE_REQUEST && bundleEntry) {
+        return processBundle();
+    }
+
+    // 选择编码，预压缩的同名文件之后与普通文件一样发送，Content-Type和Vary仍取原文件的
+    CONTENT_ENCODING encoding = ENCODING_IDENTITY;
+    const FileCache::Variant* variant = nullptr;
+    const char* type = "text/html";
+    bool vary = false;
+    if (ret == FILE_REQUEST) {
+        variant = negotiate(encoding);
+        type = file->mimeType;
+        vary = fileCache->negotiable(file);
+        if (variant && variant->sibling) {
+            FileCache::Entry* sibling = FileCache::retain(variant->sibling);
+            FileCache::release(file);
+            file = sibling;
+            variant = nullptr;
+        }
+
+        // 校验器取实际发送的文件的，压缩版本的ETag带编码后缀
+        const Validators& validators = file->validators;
+        if (notModified(validators.etags[encoding], validators.mtime, validators.lastModified)) {
+            return processNotModified(validators.lastModified, validators.etags[encoding], vary);
+        }
+
+        // 压缩版本和HEAD请求不使用渲染好的响应
+        if (encoding == ENCODING_IDENTITY && httpMethod != HEAD && processRendered()) {
+            return true;
+        }
+    }
+
+    // 本响应的头部从写缓冲区的当前位置开始，排在之前的响应之后
+    int start = writeIndex;
+
+    // 响应的内容，错误页面是静态字符串，文件是映射的内存、压缩好的内存或打开的fd，都不复制到写缓冲区
+    const char* body = nullptr;
+    off_t bodyLen = 0;
     switch (ret)
     {
         case INTERNAL_ERROR:
             addStatusLine(500, error_500_title);
-            addHeaders(strlen(error_500_form));
-            if (!addContent(error_500_form)) {
-                return false;
-            }
+            body = error_500_form;
             break;
         case BAD_REQUEST:
+            // 请求不合法时不知道它在哪里结束，读缓冲区中剩下的数据不能当作下一个请求，发送完后关闭连接
+            linger = false;
             addStatusLine(400, error_400_title);
-            addHeaders(strlen(error_400_form));
-            if (!addContent(error_400_form)) {
-                return false;
-            }
+            body = error_400_form;
             break;
         case NO_RESOURCE:
             addStatusLine(404, error_404_title);
-            addHeaders(strlen(error_404_form));
-            if (!addContent(error_404_form)) {
-                return false;
-            }
+            body = error_404_form;
             break;
         case FORBIDDEN_REQUEST:
             addStatusLine(403, error_403_title);
-            addHeaders(strlen(error_403_form));
-            if (!addContent(error_403_form)) {
-                return false;
-            }
+            body = error_403_form;
+            break;
+        case SERVICE_UNAVAILABLE:
+            // 过载时不保持连接，减少后续请求
+            linger = false;
+            addStatusLine(503, error_503_title);
+            addResponse("Retry-After: %d\r\n", 1);
+            body = error_503_form;
             break;
         case FILE_REQUEST:
             addStatusLine(200, ok_200_title);
-            addHeaders(fileStat.st_size);
-            iv[0].iov_base = writeBuffer;
-            iv[0].iov_len = writeIndex;
-            iv[1].iov_base = fileAddress;
-            iv[1].iov_len = fileStat.st_size;
-            ivCount = 2;
-            return true;
+            body = variant ? variant->data : file->map;
+            bodyLen = variant ? variant->len : file->st.st_size;
+            break;
         default:
             return false;
     }
+    if (ret != FILE_REQUEST) {
+        bodyLen = strlen(body);
+        if (!addHeaders(bodyLen, type)) {
+            return false;
+        }
+    } else if (!addFileHeaders(bodyLen, type, encoding, vary, file->validators)) {
+        return false;
+    }
+
+    // 加入发送队列，文件的引用交由队列管理，发送完后释放，HEAD请求不发送内容，不需要文件
+    bool sendBody = httpMethod != HEAD;
+    Response& response = responses[responseCount++];
+    response.file = ret == FILE_REQUEST && sendBody ? file : nullptr;
+    response.readyEnd = 0;
+    if (file && !response.file) {
+        FileCache::release(file);
+    }
+    file = nullptr;
+
+    // 工作线程不在反应堆上，直接预读冷文件的开头，小文件由此整个变为warm，大文件的其余部分发送时再由I/O线程池预读
+    if (response.file && !variant && ioPool && !response.file->warm.load(std::memory_order_relaxed)) {
+        response.readyEnd = std::min(response.file->st.st_size, PREFETCH_WINDOW);
+        fileCache->prefault(response.file, 0, response.readyEnd);
+        if (response.readyEnd == response.file->st.st_size) {
+            response.file->warm.store(true, std::memory_order_relaxed);
+        }
+    }
+    output.push(writeBuffer + start, writeIndex - start);
+    if (response.file && !body) {
+        output.pushFile(response.file->fd, 0, bodyLen, fileSend == SEND_SPLICE);
+    } else if (sendBody) {
+        output.push(body, bodyLen);
+    }
 
-    iv[0].iov_base = writeBuffer;
-    iv[0].iov_len = writeIndex;
-    ivCount = 1;
+    if (!linger) {
+        closeAfterWrite = true;
+    }
     return true;
 }
 
 // 由线程池中的工作线程调用，这是处理HTTP请求的入口函数
 void HTTPConn::process() {
-    // 解析HTTP请求
-    HTTP_CODE read_ret = processRead();
-    if (read_ret == NO_REQUEST) {
-        modfd(epollFd, socketFd, EPOLLIN);
+    // 依次处理读缓冲区中所有完整的请求，流水线中的多个响应排队后一起发送
+    pipelineFull = false;
+    while (true) {
+        // 解析HTTP请求
+        HTTP_CODE read_ret = processRead();
+        if (read_ret == NO_REQUEST) {
+            break;
+        }
+
+        // 生成响应
+        bool write_ret = processWrite(read_ret);
+        if (!write_ret) {
+            rearm(0);
+            return;
+        }
+
+        // 发送完要关闭连接，之后的请求不再处理
+        if (closeAfterWrite) {
+            break;
+        }
+
+        nextRequest();
+        if (readIndex == 0) {
+            break;
+        }
+
+        // 队列或写缓冲区已满，剩下的请求在这些响应发送完后再处理
+        if (responseCount == MAX_PIPELINE || WRITE_BUFFER_SIZE - writeIndex < MIN_RESPONSE_SPACE) {
+            pipelineFull = true;
+            break;
+        }
+    }
+
+    if (responseCount == 0) {
+        rearm(EPOLLIN);
         return;
     }
-    
-    // 生成响应
-    bool write_ret = processWrite(read_ret);
-    if (!write_ret) {
-        closeConn();
+    rearm(EPOLLOUT);
+}
+
+// 请求排队过久，回复503后关闭连接
+void HTTPConn::reject() {
+    if (!processWrite(SERVICE_UNAVAILABLE)) {
+        rearm(0);
+        return;
     }
-    modfd(epollFd, socketFd, EPOLLOUT);
+    rearm(EPOLLOUT);
 }
 
-// 当得到一个完整、正确的HTTP请求时，就分析目标文件的属性，
-// 如果目标文件存在、对所有用户可读，且不是目录，则使用mmap将其映射到内存地址fileAddress处，并告诉调用者获取文件成功
-HTTPConn::HTTP_CODE HTTPConn::doRequest()
-{
-    strcpy(realFile, docRoot);
-    int len = strlen(docRoot);
-    strncpy(realFile + len, url, FILENAME_LEN - len - 1);
+// 线程池队列已满，直接发送503，发送不完整也不再重试
+void HTTPConn::sendUnavailable() {
+    send(socketFd, busyResponse, sizeof(busyResponse) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
 
-    // 获取m_real_file文件的相关的状态信息，-1失败，0成功
-    if (stat(realFile, &fileStat) < 0) {
-        return NO_RESOURCE;
+// 通知连接所属的反应堆继续处理该连接
+void HTTPConn::rearm(int ev) {
+    if (ringReactor) {
+        // io_uring后端由反应堆线程提交后续的请求
+        ringReactor->post(this, ev);
+    } else if (ev == 0) {
+        closeConn();
+    } else {
+        modfd(epollFd, socketFd, ev);
     }
+}
 
-    // 判断访问权限
-    if (!(fileStat.st_mode & S_IROTH)) {
-        return FORBIDDEN_REQUEST;
+// 当得到一个完整、正确的HTTP请求时，从文件缓存中获取目标文件
+// 文件存在、对所有用户可读，且不是目录时，file指向打开的文件，小文件已映射到内存，大文件由sendfile或splice发送
+// 使用资源包时只在映射的索引中查找，没有任何系统调用
+HTTPConn::HTTP_CODE HTTPConn::doRequest()
+{
+    if (bundle) {
+        bundleEntry = bundle->find(url);
+        return bundleEntry ? FILE_REQUEST : NO_RESOURCE;
     }
-
-    // 判断是否是目录
-    if (S_ISDIR(fileStat.st_mode)) {
-        return BAD_REQUEST;
+    switch (fileCache->acquire(url, file)) {
+        case FILE_OK:
+            return FILE_REQUEST;
+        case FILE_NOT_FOUND:
+            return NO_RESOURCE;
+        case FILE_FORBIDDEN:
+            return FORBIDDEN_REQUEST;
+        case FILE_IS_DIR:
+            return BAD_REQUEST;
+        default:
+            return INTERNAL_ERROR;
     }
-
-    // 以只读方式打开文件
-    int fd = open(realFile, O_RDONLY);
-    // 创建内存映射
-
-    fileAddress = (char*)mmap(0, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
-}
\ No newline at end of file
+}
@@ -19,16 +19,36 @@
 #include <stdarg.h>
 #include <errno.h>
 #include "locker.h"
+#include "bufferPool.h"
+#include "httpHeaders.h"
+#include "outputQueue.h"
+#include "config.h"
+#include "fileCache.h"
+#include "bundle.h"
 #include <sys/uio.h>
+#include <atomic>
+
+class Reactor;
+template <typename T>
+class ThreadPool;
+class ConnSlab;
 
 class HTTPConn
 {
 public:
-    static const int FILENAME_LEN = 200;        // 文件名的最大长度
     static const int READ_BUFFER_SIZE = 2048;   // 读缓冲区的大小
     static const int WRITE_BUFFER_SIZE = 1024;  // 写缓冲区的大小
+    static const int IO_BUFFER_SIZE = READ_BUFFER_SIZE + WRITE_BUFFER_SIZE; // 从缓冲区池借用的缓冲区大小
+    static const int MAX_PIPELINE = 8;          // 流水线中一次最多排队的响应个数
+    static const int MIN_RESPONSE_SPACE = 320;  // 排队下一个响应前写缓冲区至少剩余的空间，足够放下错误页面或文件响应的头部
+    static const int WRITE_BUDGET = 1 << 20;    // epoll后端每次可写事件最多发送的字节数，超过后让出给其他连接
+    static const off_t READY_AHEAD = 4 << 20;   // 发送前确认已在页缓存中的字节数，不小于一次发送的最大量
+    static const off_t PREFETCH_WINDOW = 8 << 20; // I/O线程每次预读的字节数
+
+    // 读写缓冲区共用一块从池中借用的缓冲区
+    typedef BufferPool<IO_BUFFER_SIZE> IOBufferPool;
     
-    // HTTP请求方法，这里只支持GET
+    // HTTP请求方法，这里只支持GET和HEAD
     enum METHOD {GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT};
     
     /*
@@ -49,46 +69,122 @@ public:
         FILE_REQUEST        :   文件请求,获取文件成功
         INTERNAL_ERROR      :   表示服务器内部错误
         CLOSED_CONNECTION   :   表示客户端已经关闭连接了
+        SERVICE_UNAVAILABLE :   表示服务器过载，拒绝处理该请求
     */
-    enum HTTP_CODE {NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION};
+    enum HTTP_CODE {NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION, SERVICE_UNAVAILABLE};
     
     // 从状态机的三种可能状态，即行的读取状态，分别表示
     // 1.读取到一个完整的行 2.行出错 3.行数据尚且不完整
     enum LINE_STATUS { LINE_OK = 0, LINE_BAD, LINE_OPEN };
 
 public:
-    HTTPConn(){}
+    HTTPConn() : socketFd(-1), ioBuffer(nullptr), readBuffer(nullptr), writeBuffer(nullptr), file(nullptr), bundleEntry(nullptr), responseCount(0) {}
     ~HTTPConn(){}
 public:
-    // 初始化新接受的连接
-    void init(int sockfd, const sockaddr_in& addr); 
+    // 初始化新接受的连接，sockfd需已是非阻塞的，owner为分配该对象的slab，关闭连接时归还
+    // epollfd为接受该连接的反应堆的epoll对象，使用io_uring后端时为-1，ring为驱动该连接的反应堆
+    void init(int sockfd, const sockaddr_in& addr, ConnSlab* owner, int epollfd, Reactor* ring = nullptr);
 
-    // 关闭连接
+    // 关闭连接并把对象归还给slab，此后不能再访问该对象
     void closeConn();  
 
     // 处理客户端请求
     void process(); 
 
+    // 由工作线程调用，请求排队过久时不解析请求，回复503后关闭连接
+    void reject();
+
+    // 由反应堆线程调用，线程池队列已满时直接在socket上发送503，之后由调用者关闭连接
+    void sendUnavailable();
+
     // 非阻塞读
     bool read();
 
     // 非阻塞写
     bool write();
 
+    // 下面这一组函数供io_uring后端使用，由反应堆完成实际的收发
+    // 把已收到的数据追加到读缓冲区，缓冲区满则返回false
+    bool receive(const char* data, int len);
+
+    // 获取待发送的内存段，流水线中排队的多个响应依次排列，count最多为IOV_MAX
+    const struct iovec* responseIov(int& count) const {
+        return output.segments(count);
+    }
+
+    // io_uring后端发出了n字节
+    void consumeOutput(size_t n) {
+        output.consume(n);
+    }
+
+    // 发送前由反应堆线程调用，检查接下来要发送的文件内容是否已预读到页缓存中
+    // 没有时交给I/O线程池预读，预读完成后重新投递EPOLLOUT，返回false时调用者应暂停发送
+    bool fileReady();
+
+    // 响应是否已全部发出
+    bool outputDone() const {
+        return output.empty();
+    }
+
+    // 响应发送完毕，返回是否保持连接
+    bool finishWrite();
+
+    // 响应发送完毕后，读缓冲区中是否还有因排队已满而未处理的请求，有则应立即再交给线程池
+    bool hasBufferedRequest() const {
+        return pipelineFull && responseCount == 0;
+    }
+
+    // 获取连接的socket
+    int getFd() const {
+        return socketFd;
+    }
+
 private:
     // 初始化连接
     void init();    
 
+    // 重置单个请求的解析状态，读缓冲区中的数据保留
+    void resetRequest();
+
+    // 当前请求的响应已排队，把读缓冲区中剩余的数据移到开头，准备解析流水线中的下一个请求
+    void nextRequest();
+
+    // 通知连接所属的反应堆：EPOLLIN表示继续读，EPOLLOUT表示响应已就绪，0表示关闭连接
+    void rearm(int ev);
+
+    // 有数据到达时从池中借用读写缓冲区
+    void attachBuffer();
+
+    // 响应发送完毕或连接关闭时归还缓冲区，空闲的长连接不占用缓冲区
+    void releaseBuffer();
+
     // 解析HTTP请求
     HTTP_CODE processRead();    
 
     // 填充HTTP应答
     bool processWrite(HTTP_CODE ret);    
 
+    // 小文件发送预先渲染好的完整响应，没有时先渲染，无法渲染时返回false，由processWrite按常规方式生成
+    bool processRendered();
+    FileCache::Rendered* renderResponse();
+
+    // 按Accept-Encoding选择文件的编码，返回已有的压缩版本，没有时返回nullptr并发送原始内容
+    // 第一次请求某个编码时，需要压缩的文件交给I/O线程池在后台压缩
+    const FileCache::Variant* negotiate(CONTENT_ENCODING& encoding);
+
+    // 条件请求的校验器与etag或lastModified匹配，应回复304
+    bool notModified(const char* etag, time_t mtime, const char* lastModified) const;
+
+    // 回复304，释放文件，只发送校验器等头部
+    bool processNotModified(const char* lastModified, const char* etag, bool vary);
+
+    // 从资源包发送预先生成的头部和内容，客户端接受gzip且有压缩版本时发送压缩版本
+    bool processBundle();
+
     // 下面这一组函数被processRead调用以分析HTTP请求
-    HTTP_CODE parseRequestLine(char* text);
-    HTTP_CODE parseHeaders(char* text);
-    HTTP_CODE parseContent(char* text);
+    HTTP_CODE parseRequestLine(char* text, int len);
+    HTTP_CODE parseHeaders(char* text, int len);
+    HTTP_CODE parseContent();
     HTTP_CODE doRequest();
     char* getLine() {return readBuffer + startLine;}
     LINE_STATUS parseLine();
@@ -97,27 +193,52 @@ private:
     void unmap();
     bool addResponse(const char* format, ...);
     bool addContent(const char* content);
-    bool addContentType();
+    bool addContentType(const char* type);
     bool addStatusLine(int status, const char* title);
-    bool addHeaders(int content_length);
-    bool addContentLength(int content_length);
+    bool addHeaders(off_t content_length, const char* type);
+    bool addFileHeaders(off_t content_length, const char* type, CONTENT_ENCODING encoding, bool vary,
+                        const Validators& validators);
+    bool addVary();
+    bool addValidators(const char* lastModified, const char* etag);
+    bool addContentLength(off_t content_length);
     bool addLinger();
     bool addBlankLine();
 
 public:
-    // 所有socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态的
-    static int epollFd;
+    // 统计用户的数量，多个反应堆和工作线程会同时修改
+    static std::atomic<int> userCount;
+
+    // 没有映射到内存的文件的发送方式，启动时由main设置
+    static FILE_SEND fileSend;
+
+    // 打开的文件的缓存，启动时由main创建
+    static FileCache* fileCache;
 
-    // 统计用户的数量
-    static int userCount;    
+    // 预读冷文件的I/O线程池，为nullptr时不预读，缺页发生在发送的线程中
+    static ThreadPool<HTTPConn>* ioPool;
+
+    // 静态资源包，不为nullptr时所有请求都从中查找，不再访问网站根目录
+    static Bundle* bundle;
 
 private:
+    // 分配该对象的slab
+    ConnSlab* slab;
+
+    // 该连接注册到的epoll对象，多反应堆模式下每个反应堆有各自的epoll对象
+    int epollFd;
+
+    // 使用io_uring后端时驱动该连接的反应堆，否则为nullptr
+    Reactor* ringReactor;
+
     // 该HTTP连接的socket和对方的socket地址
     int socketFd;
     sockaddr_in address;
 
-    // 读缓冲区
-    char readBuffer[READ_BUFFER_SIZE];
+    // 从池中借用的缓冲区，请求处理期间才持有
+    char* ioBuffer;
+
+    // 读缓冲区，指向ioBuffer的前READ_BUFFER_SIZE字节
+    char* readBuffer;
 
     // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
     int readIndex; 
@@ -134,9 +255,6 @@ private:
     // 请求方法            
     METHOD httpMethod;
 
-    // 客户请求的目标文件的完整路径，其内容等于 doc_root + m_url, doc_root是网站根目录
-    char realFile[FILENAME_LEN];    
-
     // 客户请求的目标文件的文件名   
     char* url;       
 
@@ -146,27 +264,47 @@ private:
     // 主机名       
     char* hostName;   
 
-    // HTTP请求的消息总长度                        
-    int contentLength;   
+    // 请求的所有头部字段，指向读缓冲区
+    HeaderTable headers;
+
+    // HTTP请求的消息体长度，不超过读缓冲区的剩余空间
+    off_t contentLength;
 
     // HTTP请求是否要求保持连接
     bool linger;                          
 
-    // 写缓冲区
-    char writeBuffer[WRITE_BUFFER_SIZE];  
+    // 写缓冲区，指向ioBuffer的后WRITE_BUFFER_SIZE字节
+    char* writeBuffer;
 
     // 写缓冲区中待发送的字节数
     int writeIndex;
 
-    // 客户请求的目标文件被mmap到内存中的起始位置                        
-    char* fileAddress; 
+    // 客户请求的目标文件，来自文件缓存，持有一个引用
+    FileCache::Entry* file;
+
+    // 使用资源包时客户请求的目标文件，资源包一直映射，不需要引用计数
+    const BundleEntry* bundleEntry;
+
+    // 一个排队的响应使用的文件，发送完后释放引用
+    // 文件不是warm时，readyEnd之前的内容已预读到页缓存中
+    struct Response {
+        FileCache::Entry* file;
+        off_t readyEnd;
+    };
+
+    // 流水线中排队等待发送的响应
+    Response responses[MAX_PIPELINE];
+    int responseCount;
+
+    // 所有排队响应的头部、错误页面和文件内容
+    OutputQueue output;
+
+    // 已排队的响应中有要求关闭连接的，发送完后关闭
+    bool closeAfterWrite;
 
-    // 目标文件的状态。通过它可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-    struct stat fileStat;  
+    // 因排队已满停止处理，读缓冲区中可能还有完整的请求
+    bool pipelineFull;
 
-    // 采用writev来执行写操作，所以定义下面两个成员，其中ivCount表示被写内存块的数量。              
-    struct iovec iv[2];                   
-    int ivCount;
 };
 
 #endif
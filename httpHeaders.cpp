@@ -0,0 +1,281 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <strings.h>
+#include "httpHeaders.h"
+
+// 已知字段的小写名字，顺序与HEADER_ID一致
+static constexpr const char* knownNames[HEADER_COUNT] = {
+    "host", "connection", "content-length", "content-type", "transfer-encoding",
+    "accept", "accept-encoding", "accept-language", "if-none-match", "if-modified-since",
+    "if-range", "range", "user-agent", "referer", "cookie", "cache-control",
+    "upgrade", "expect",
+};
+
+static constexpr int constLen(const char* s) {
+    int n = 0;
+    while (s[n]) {
+        n++;
+    }
+    return n;
+}
+
+// 完美哈希：h = (长度 * a + 首字符 * b + 末字符 * c) % SIZE，字符按小写计算
+// 编译期枚举a、b、c，取第一组使所有已知名字落在不同槽中的参数
+struct HeaderHash {
+    static const int SIZE = 32;
+    static const int MAX_FACTOR = 16;
+
+    int a, b, c;
+    int8_t slots[SIZE];
+
+    constexpr unsigned hash(int len, unsigned char head, unsigned char tail) const {
+        return (unsigned)(len * a + (head | 0x20) * b + (tail | 0x20) * c) % SIZE;
+    }
+};
+
+static constexpr HeaderHash buildHeaderHash() {
+    HeaderHash h = {0, 0, 0, {}};
+    for (int a = 1; a < HeaderHash::MAX_FACTOR; a++) {
+        for (int b = 1; b < HeaderHash::MAX_FACTOR; b++) {
+            for (int c = 1; c < HeaderHash::MAX_FACTOR; c++) {
+                h.a = a;
+                h.b = b;
+                h.c = c;
+                for (int i = 0; i < HeaderHash::SIZE; i++) {
+                    h.slots[i] = -1;
+                }
+                bool ok = true;
+                for (int id = 0; id < HEADER_COUNT && ok; id++) {
+                    const char* name = knownNames[id];
+                    int len = constLen(name);
+                    unsigned slot = h.hash(len, name[0], name[len - 1]);
+                    if (h.slots[slot] >= 0) {
+                        ok = false;
+                    } else {
+                        h.slots[slot] = id;
+                    }
+                }
+                if (ok) {
+                    return h;
+                }
+            }
+        }
+    }
+    return HeaderHash{0, 0, 0, {}};
+}
+
+static constexpr HeaderHash headerHash = buildHeaderHash();
+static_assert(headerHash.a != 0, "no perfect hash for the known header names, enlarge HeaderHash::SIZE");
+
+// 已知名字的长度
+static constexpr struct KnownLens {
+    int lens[HEADER_COUNT];
+    constexpr KnownLens() : lens() {
+        for (int i = 0; i < HEADER_COUNT; i++) {
+            lens[i] = constLen(knownNames[i]);
+        }
+    }
+} knownLens;
+
+// 按名字识别字段
+HEADER_ID classifyHeader(const char* name, int len) {
+    if (len <= 0) {
+        return HEADER_UNKNOWN;
+    }
+    int id = headerHash.slots[headerHash.hash(len, name[0], name[len - 1])];
+    if (id < 0 || knownLens.lens[id] != len) {
+        return HEADER_UNKNOWN;
+    }
+    // 已知名字只含小写字母和'-'，或上0x20把大写字母转为小写，行内不会出现能变成'-'的'\r'
+    const char* known = knownNames[id];
+    for (int i = 0; i < len; i++) {
+        if ((name[i] | 0x20) != known[i]) {
+            return HEADER_UNKNOWN;
+        }
+    }
+    return (HEADER_ID)id;
+}
+
+// 字段的小写名字
+const char* headerName(HEADER_ID id) {
+    return id < HEADER_COUNT ? knownNames[id] : "unknown";
+}
+
+// 加入一个字段
+bool HeaderTable::add(const char* name, int nameLen, const char* value, int valueLen) {
+    if (count >= MAX_HEADERS) {
+        return false;
+    }
+    Field& field = fields[count];
+    field.name = name;
+    field.nameLen = nameLen;
+    field.value = value;
+    field.valueLen = valueLen;
+    field.id = classifyHeader(name, nameLen);
+    if (field.id != HEADER_UNKNOWN && first[field.id] < 0) {
+        first[field.id] = count;
+    }
+    count++;
+    return true;
+}
+
+// 字段的值是否与text相同
+bool HeaderTable::equals(HEADER_ID id, const char* text) const {
+    const Field* field = find(id);
+    return field && (size_t)field->valueLen == strlen(text) && strncasecmp(field->value, text, field->valueLen) == 0;
+}
+
+// 在列表字段的值中查找token，找到时params指向其后的参数（";q=0.5"），没有参数时指向end
+static bool findToken(const char* p, const char* end, const char* token, const char*& params) {
+    size_t tokenLen = strlen(token);
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        const char* item = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        const char* itemEnd = p;
+        while (p < end && *p != ',') {
+            p++;
+        }
+        if ((size_t)(itemEnd - item) == tokenLen && strncasecmp(item, token, tokenLen) == 0) {
+            params = itemEnd;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 列表字段中是否包含token
+bool HeaderTable::hasToken(HEADER_ID id, const char* token) const {
+    if (!has(id)) {
+        return false;
+    }
+    const char* params;
+    for (int i = first[id]; i < count; i++) {
+        if (fields[i].id == id && findToken(fields[i].value, fields[i].value + fields[i].valueLen, token, params)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 消息体长度
+bool HeaderTable::contentLength(off_t& length) const {
+    length = 0;
+    if (!has(HEADER_CONTENT_LENGTH)) {
+        return true;
+    }
+    bool seen = false;
+    for (int i = first[HEADER_CONTENT_LENGTH]; i < count; i++) {
+        const Field& field = fields[i];
+        if (field.id != HEADER_CONTENT_LENGTH) {
+            continue;
+        }
+        // strtol会跳过前导空白、接受正负号，这里只允许数字开头，值之后是被去掉的空白或行尾的空字符
+        if (field.valueLen == 0 || field.value[0] < '0' || field.value[0] > '9') {
+            return false;
+        }
+        char* end;
+        errno = 0;
+        long n = strtol(field.value, &end, 10);
+        if (errno == ERANGE || end != field.value + field.valueLen || (seen && n != length)) {
+            return false;
+        }
+        length = n;
+        seen = true;
+    }
+    return true;
+}
+
+// 客户端是否接受该内容编码
+bool HeaderTable::acceptsEncoding(const char* coding) const {
+    if (!has(HEADER_ACCEPT_ENCODING)) {
+        return false;
+    }
+    const char* params;
+    for (int i = first[HEADER_ACCEPT_ENCODING]; i < count; i++) {
+        const Field& field = fields[i];
+        const char* end = field.value + field.valueLen;
+        if (field.id != HEADER_ACCEPT_ENCODING || !findToken(field.value, end, coding, params)) {
+            continue;
+        }
+        // gzip;q=0 表示明确拒绝
+        const char* q = params;
+        while (q < end && *q != ',' && !(q[0] == 'q' && q + 1 < end && q[1] == '=')) {
+            q++;
+        }
+        return !(q < end && q[0] == 'q' && atof(q + 2) == 0.0);
+    }
+    return false;
+}
+
+// If-None-Match中是否有匹配的实体标签
+bool HeaderTable::matchesETag(const char* etag) const {
+    if (!has(HEADER_IF_NONE_MATCH)) {
+        return false;
+    }
+    size_t len = strlen(etag);
+    for (int i = first[HEADER_IF_NONE_MATCH]; i < count; i++) {
+        const Field& field = fields[i];
+        if (field.id != HEADER_IF_NONE_MATCH) {
+            continue;
+        }
+        const char* p = field.value;
+        const char* end = p + field.valueLen;
+        while (p < end) {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+                p++;
+            }
+            if (p < end && *p == '*') {
+                return true;
+            }
+            if (end - p >= 2 && p[0] == 'W' && p[1] == '/') {
+                p += 2;
+            }
+            // 带引号的标签，不合法的项跳到下一个逗号
+            const char* tag = p;
+            if (p < end && *p == '"') {
+                p++;
+                while (p < end && *p != '"') {
+                    p++;
+                }
+                if (p < end) {
+                    p++;
+                }
+                if ((size_t)(p - tag) == len && memcmp(tag, etag, len) == 0) {
+                    return true;
+                }
+            }
+            while (p < end && *p != ',') {
+                p++;
+            }
+        }
+    }
+    return false;
+}
+
+// If-Modified-Since之后是否没有修改过
+bool HeaderTable::notModifiedSince(time_t mtime, const char* lastModified) const {
+    const Field* field = find(HEADER_IF_MODIFIED_SINCE);
+    if (!field) {
+        return false;
+    }
+    if ((size_t)field->valueLen == strlen(lastModified) && memcmp(field->value, lastModified, field->valueLen) == 0) {
+        return true;
+    }
+
+    // 值指向读缓冲区，没有以空字符结尾，复制后按IMF-fixdate格式解析，其他格式视为没有该字段
+    char date[64];
+    if (field->valueLen >= sizeof(date)) {
+        return false;
+    }
+    memcpy(date, field->value, field->valueLen);
+    date[field->valueLen] = '\0';
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* rest = strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return rest && *rest == '\0' && timegm(&tm) >= mtime;
+}
@@ -0,0 +1,104 @@
+#ifndef HTTPHEADERS_H
+#define HTTPHEADERS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string.h>
+#include <time.h>
+
+// 能识别的请求头字段，HEADER_UNKNOWN表示其他字段
+enum HEADER_ID {
+    HEADER_HOST = 0, HEADER_CONNECTION, HEADER_CONTENT_LENGTH, HEADER_CONTENT_TYPE, HEADER_TRANSFER_ENCODING,
+    HEADER_ACCEPT, HEADER_ACCEPT_ENCODING, HEADER_ACCEPT_LANGUAGE, HEADER_IF_NONE_MATCH, HEADER_IF_MODIFIED_SINCE,
+    HEADER_IF_RANGE, HEADER_RANGE, HEADER_USER_AGENT, HEADER_REFERER, HEADER_COOKIE, HEADER_CACHE_CONTROL,
+    HEADER_UPGRADE, HEADER_EXPECT,
+    HEADER_COUNT, HEADER_UNKNOWN = HEADER_COUNT
+};
+
+// 按名字识别字段，不区分大小写，用编译期生成的完美哈希，只需一次比较
+HEADER_ID classifyHeader(const char* name, int len);
+
+// 字段的小写名字，用于打印
+const char* headerName(HEADER_ID id);
+
+// 一个请求的所有头部字段，名字和值都直接指向读缓冲区，不复制
+// 解析时每个字段只识别一次，之后按HEADER_ID取值不再扫描，指针在读缓冲区被复用之前有效
+class HeaderTable {
+public:
+    // 最多记录的字段个数，字段更多的请求被拒绝
+    static const int MAX_HEADERS = 32;
+
+    // 一个字段，值不含首尾的空白
+    struct Field {
+        const char* name;
+        const char* value;
+        uint16_t nameLen;
+        uint16_t valueLen;
+        HEADER_ID id;
+    };
+
+    HeaderTable() {
+        clear();
+    }
+
+    // 清空，开始解析下一个请求
+    void clear() {
+        count = 0;
+        memset(first, -1, sizeof(first));
+    }
+
+    // 加入一个字段，已有MAX_HEADERS个字段时返回false
+    bool add(const char* name, int nameLen, const char* value, int valueLen);
+
+    // 字段个数及第i个字段
+    int size() const {
+        return count;
+    }
+    const Field& at(int i) const {
+        return fields[i];
+    }
+
+    // 第一个该类的字段，没有则返回nullptr
+    const Field* find(HEADER_ID id) const {
+        return first[id] < 0 ? nullptr : &fields[(int)first[id]];
+    }
+
+    bool has(HEADER_ID id) const {
+        return first[id] >= 0;
+    }
+
+    // 字段的值是否与text相同，不区分大小写
+    bool equals(HEADER_ID id, const char* text) const;
+
+    // 以逗号分隔的列表字段中是否包含token，不区分大小写，忽略";q="等参数，同名字段出现多次时都检查
+    bool hasToken(HEADER_ID id, const char* token) const;
+
+    // 以下为常用字段的类型化访问
+    // 消息体长度，没有该字段时为0
+    // 值不是纯十进制数字、溢出，或多个字段的值不一致时返回false，调用者应回复400
+    bool contentLength(off_t& length) const;
+
+    // 是否要求保持连接
+    bool keepAlive() const {
+        return hasToken(HEADER_CONNECTION, "keep-alive");
+    }
+
+    // 客户端是否接受该内容编码，q=0视为不接受
+    bool acceptsEncoding(const char* coding) const;
+
+    // If-None-Match中是否有与etag相同的实体标签，etag带引号，按弱比较忽略W/前缀，"*"匹配任何实体
+    bool matchesETag(const char* etag) const;
+
+    // If-Modified-Since给出的时间不早于mtime，即此后没有修改过
+    // 客户端通常原样带回Last-Modified，与lastModified相同时不解析日期
+    bool notModifiedSince(time_t mtime, const char* lastModified) const;
+
+private:
+    Field fields[MAX_HEADERS];
+    int count;
+
+    // 每类字段第一次出现的位置，-1表示没有
+    int8_t first[HEADER_COUNT];
+};
+
+#endif
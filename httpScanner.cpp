@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+#include "httpScanner.h"
+
+// 各实现的签名相同，通过函数指针在运行时选择
+typedef const char* (*ScanFunc)(const char* p, const char* end, const char* delims, int n);
+
+// 逐字节查找，也用于向量实现处理不足一个步长的尾部
+static const char* scanScalar(const char* p, const char* end, const char* delims, int n) {
+    if (n == 1) {
+        const char* found = (const char*)memchr(p, delims[0], end - p);
+        return found ? found : end;
+    }
+    // 分隔符的位图，每个字节只查一次表
+    uint64_t set[4] = {0, 0, 0, 0};
+    for (int i = 0; i < n; i++) {
+        unsigned char c = delims[i];
+        set[c >> 6] |= 1ull << (c & 63);
+    }
+    for (; p < end; p++) {
+        unsigned char c = *p;
+        if (set[c >> 6] & (1ull << (c & 63))) {
+            return p;
+        }
+    }
+    return end;
+}
+
+// SSE4.2：pcmpestri一次比较16字节与最多16个分隔符
+__attribute__((target("sse4.2")))
+static const char* scanSse42(const char* p, const char* end, const char* delims, int n) {
+    char set[16] = {0};
+    memcpy(set, delims, n);
+    const __m128i needles = _mm_loadu_si128((const __m128i*)set);
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)p);
+        int idx = _mm_cmpestri(needles, n, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16) {
+            return p + idx;
+        }
+    }
+    return scanScalar(p, end, delims, n);
+}
+
+// AVX2：每个分隔符比较一次再合并，一次处理32字节，分隔符多于4个时比较次数过多，交给SSE4.2
+__attribute__((target("avx2,sse4.2")))
+static const char* scanAvx2(const char* p, const char* end, const char* delims, int n) {
+    if (n > 4) {
+        return scanSse42(p, end, delims, n);
+    }
+    __m256i needles[4];
+    for (int i = 0; i < n; i++) {
+        needles[i] = _mm256_set1_epi8(delims[i]);
+    }
+    for (; end - p >= 32; p += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)p);
+        __m256i hits = _mm256_cmpeq_epi8(block, needles[0]);
+        for (int i = 1; i < n; i++) {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, needles[i]));
+        }
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hits);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return scanSse42(p, end, delims, n);
+}
+
+// 可选的实现，按优先级从高到低排列
+static const struct {
+    const char* name;
+    const char* feature;
+    ScanFunc func;
+} scanners[] = {
+    {"avx2", "avx2", scanAvx2},
+    {"sse4.2", "sse4.2", scanSse42},
+    {"scalar", nullptr, scanScalar},
+};
+
+static const int SCANNER_COUNT = sizeof(scanners) / sizeof(scanners[0]);
+
+// CPU是否支持第i个实现
+static bool supported(int i) {
+    const char* feature = scanners[i].feature;
+    if (!feature) {
+        return true;
+    }
+    __builtin_cpu_init();
+    if (strcmp(feature, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+    }
+    return __builtin_cpu_supports("sse4.2");
+}
+
+// 选择CPU支持的最快的实现
+static int detect() {
+    for (int i = 0; i < SCANNER_COUNT; i++) {
+        if (supported(i)) {
+            return i;
+        }
+    }
+    return SCANNER_COUNT - 1;
+}
+
+static int current = detect();
+
+// 在[p, end)中查找第一个属于delims的字符
+const char* scanDelims(const char* p, const char* end, const char* delims, int n) {
+    return scanners[current].func(p, end, delims, n);
+}
+
+// 当前使用的实现
+const char* scannerName() {
+    return scanners[current].name;
+}
+
+// 指定使用的实现
+bool selectScanner(const char* name) {
+    for (int i = 0; i < SCANNER_COUNT; i++) {
+        if (strcmp(scanners[i].name, name) == 0 && supported(i)) {
+            current = i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,21 @@
+#ifndef HTTPSCANNER_H
+#define HTTPSCANNER_H
+
+// HTTP请求的向量化扫描，用于查找行尾和各种分隔符
+// 启动时按CPU支持的指令集选择AVX2（每次32字节）、SSE4.2（每次16字节）或逐字节的实现
+
+// 在[p, end)中查找第一个属于delims（n个字符，最多16个）的字符，返回其位置，没有则返回end
+const char* scanDelims(const char* p, const char* end, const char* delims, int n);
+
+// 查找行尾，即第一个'\r'或'\n'
+inline const char* scanLineEnd(const char* p, const char* end) {
+    return scanDelims(p, end, "\r\n", 2);
+}
+
+// 当前使用的实现："avx2"、"sse4.2"或"scalar"
+const char* scannerName();
+
+// 指定使用的实现，CPU不支持或名字无效时返回false且不改变，主要用于基准测试
+bool selectScanner(const char* name);
+
+#endif
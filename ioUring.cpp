@@ -0,0 +1,287 @@
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include "ioUring.h"
+#include "affinity.h"
+
+// 内核与用户态共享的队列指针需要使用获取/释放语义访问
+static inline unsigned loadAcquire(unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void storeRelease(unsigned* p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// 构造函数
+IoUring::IoUring(unsigned entries) :
+    ringFd(-1), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0),
+    sqes((io_uring_sqe*)MAP_FAILED), sqesSize(0), sqeTail(0),
+    bufRing(nullptr), bufRingSize(0), bufMask(0), bufBase(nullptr), bufCount(0), bufSize(0), bufGroup(0), recycled(0)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    // 完成队列开大一些，多发请求会持续产生完成事件
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd < 0) {
+        throw std::exception();
+    }
+
+    // 映射提交队列和完成队列，新内核上二者共用一次映射
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cqRingSize > sqRingSize) {
+            sqRingSize = cqRingSize;
+        }
+        cqRingSize = sqRingSize;
+    }
+
+    sqRing = mmap(0, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        close(ringFd);
+        throw std::exception();
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(0, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            munmap(sqRing, sqRingSize);
+            close(ringFd);
+            throw std::exception();
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*)mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        if (cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        munmap(sqRing, sqRingSize);
+        close(ringFd);
+        throw std::exception();
+    }
+
+    char* sq = (char*)sqRing;
+    sqHead = (unsigned*)(sq + params.sq_off.head);
+    sqTail = (unsigned*)(sq + params.sq_off.tail);
+    sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    sqArray = (unsigned*)(sq + params.sq_off.array);
+    sqeTail = *sqTail;
+
+    char* cq = (char*)cqRing;
+    cqHead = (unsigned*)(cq + params.cq_off.head);
+    cqTail = (unsigned*)(cq + params.cq_off.tail);
+    cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+}
+
+// 析构函数
+IoUring::~IoUring() {
+    if (bufRing) {
+        munmap(bufRing, bufRingSize);
+    }
+    if (bufBase) {
+        freeOnNode(bufBase, (size_t)bufCount * bufSize);
+    }
+    munmap(sqes, sqesSize);
+    if (cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    munmap(sqRing, sqRingSize);
+    close(ringFd);
+}
+
+// 获取一个空闲的提交队列项
+io_uring_sqe* IoUring::getSqe() {
+    unsigned mask = *sqMask;
+    if (sqeTail - loadAcquire(sqHead) > mask) {
+        // 提交队列已满，先把已有的请求交给内核
+        submitAndWait(0);
+        if (sqeTail - loadAcquire(sqHead) > mask) {
+            return nullptr;
+        }
+    }
+    io_uring_sqe* sqe = &sqes[sqeTail & mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[sqeTail & mask] = sqeTail & mask;
+    sqeTail++;
+    return sqe;
+}
+
+// 提交并等待完成事件
+int IoUring::submitAndWait(unsigned waitNr) {
+    unsigned toSubmit = sqeTail - *sqTail;
+    storeRelease(sqTail, sqeTail);
+
+    unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    return syscall(__NR_io_uring_enter, ringFd, toSubmit, waitNr, flags, nullptr, 0);
+}
+
+// 取出一个完成事件
+io_uring_cqe* IoUring::peekCqe() {
+    unsigned head = *cqHead;
+    if (head == loadAcquire(cqTail)) {
+        return nullptr;
+    }
+    return &cqes[head & *cqMask];
+}
+
+// 标记当前完成事件已处理
+void IoUring::cqeSeen() {
+    storeRelease(cqHead, *cqHead + 1);
+}
+
+// 注册提供缓冲区环
+void IoUring::setupBufRing(unsigned short bgid, unsigned count, unsigned size, int node) {
+    // 环的大小必须是2的幂
+    if (count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+        throw std::exception();
+    }
+
+    bufGroup = bgid;
+    bufSize = size;
+    bufBase = (char*)allocOnNode((size_t)count * size, node);
+    bufCount = count;
+
+    bufRingSize = count * sizeof(io_uring_buf);
+    void* ring = mmap(0, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        throw std::exception();
+    }
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring;
+    reg.ring_entries = count;
+    reg.bgid = bgid;
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0) {
+        bufRing = (io_uring_buf_ring*)ring;
+        bufMask = count - 1;
+
+        // 把所有缓冲区交给内核
+        for (unsigned i = 0; i < count; i++) {
+            io_uring_buf* buf = &bufRing->bufs[i];
+            buf->addr = (unsigned long)bufAddr(i);
+            buf->len = size;
+            buf->bid = i;
+        }
+        __atomic_store_n(&bufRing->tail, (unsigned short)count, __ATOMIC_RELEASE);
+
+        if (probeBufRing()) {
+            return;
+        }
+
+        // 有的内核能注册缓冲区环却选不出缓冲区，注销后退回旧接口
+        io_uring_buf_reg unreg;
+        memset(&unreg, 0, sizeof(unreg));
+        unreg.bgid = bgid;
+        syscall(__NR_io_uring_register, ringFd, IORING_UNREGISTER_PBUF_RING, &unreg, 1);
+        bufRing = nullptr;
+    }
+    munmap(ring, bufRingSize);
+
+    // 一次性提供所有缓冲区，并等待其完成
+    if (!provideBufs(0, count)) {
+        throw std::exception();
+    }
+    submitAndWait(1);
+    io_uring_cqe* cqe = peekCqe();
+    int res = cqe ? cqe->res : -1;
+    if (cqe) {
+        cqeSeen();
+    }
+    if (res < 0) {
+        throw std::exception();
+    }
+}
+
+// 用一次recv检查缓冲区环是否可用，此时ring中没有其他请求
+bool IoUring::probeBufRing() {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        return false;
+    }
+    char c = 0;
+    ::write(sv[1], &c, 1);
+
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sv[0];
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufGroup;
+    submitAndWait(1);
+
+    bool ok = false;
+    io_uring_cqe* cqe = peekCqe();
+    if (cqe) {
+        ok = cqe->res == 1 && (cqe->flags & IORING_CQE_F_BUFFER);
+        if (ok) {
+            recycleBuf(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        cqeSeen();
+    }
+    close(sv[0]);
+    close(sv[1]);
+    return ok;
+}
+
+// 通过IORING_OP_PROVIDE_BUFFERS提供缓冲区
+io_uring_sqe* IoUring::provideBufs(unsigned short bid, unsigned nbufs) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        return nullptr;
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = nbufs;
+    sqe->addr = (unsigned long)bufAddr(bid);
+    sqe->len = bufSize;
+    sqe->off = bid;
+    sqe->buf_group = bufGroup;
+    return sqe;
+}
+
+// 将缓冲区归还给内核
+void IoUring::recycleBuf(unsigned short bid) {
+    if (!bufRing) {
+        // 旧接口需要一个提交项，成功时不产生完成事件
+        io_uring_sqe* sqe = provideBufs(bid, 1);
+        if (sqe) {
+            sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+            recycled++;
+        } else {
+            unrecycled.push_back(bid);
+        }
+        return;
+    }
+
+    unsigned short tail = bufRing->tail;
+    io_uring_buf* buf = &bufRing->bufs[tail & bufMask];
+    buf->addr = (unsigned long)bufAddr(bid);
+    buf->len = bufSize;
+    buf->bid = bid;
+    __atomic_store_n(&bufRing->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+    recycled++;
+}
+
+// 归还之前未能归还的缓冲区，仍然失败的留到下次
+void IoUring::retryRecycle() {
+    std::vector<unsigned short> bids;
+    bids.swap(unrecycled);
+    for (size_t i = 0; i < bids.size(); i++) {
+        recycleBuf(bids[i]);
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <linux/io_uring.h>
+#include <exception>
+#include <vector>
+
+// io_uring的简单封装，直接使用系统调用，不依赖liburing
+// 只允许一个线程提交和收割，由所属的反应堆线程使用
+class IoUring {
+public:
+    // 构造函数，创建entries大小的提交队列，失败则抛出异常
+    IoUring(unsigned entries);
+
+    // 析构函数，解除映射并关闭ring
+    ~IoUring();
+
+    // 获取一个空闲的提交队列项，队列已满时先提交再获取
+    // 内核暂时无法接收（如完成队列溢出）而队列仍满时返回nullptr，调用者需在收割完成事件后重试
+    io_uring_sqe* getSqe();
+
+    // 提交所有待提交的请求，并至少等待waitNr个完成事件
+    int submitAndWait(unsigned waitNr);
+
+    // 取出一个完成事件，没有则返回nullptr
+    io_uring_cqe* peekCqe();
+
+    // 标记当前完成事件已处理
+    void cqeSeen();
+
+    // 注册提供缓冲区环，共count个大小为size的缓冲区，组号为bgid，失败则抛出异常
+    // 缓冲区优先放在NUMA节点node上，-1表示不指定
+    // 内核不支持缓冲区环时退回到IORING_OP_PROVIDE_BUFFERS
+    void setupBufRing(unsigned short bgid, unsigned count, unsigned size, int node = -1);
+
+    // 是否使用了缓冲区环，false表示退回到了IORING_OP_PROVIDE_BUFFERS
+    bool usingBufRing() const {
+        return bufRing != nullptr;
+    }
+
+    // 获取编号为bid的提供缓冲区的地址
+    char* bufAddr(unsigned short bid) {
+        return bufBase + (size_t)bid * bufSize;
+    }
+
+    // 将编号为bid的缓冲区归还给内核
+    // 使用旧接口且提交队列已满时先记下，由retryRecycle在收割完成事件后归还
+    void recycleBuf(unsigned short bid);
+
+    // 归还之前因提交队列已满未能归还的缓冲区
+    void retryRecycle();
+
+    // 累计实际归还给内核的缓冲区个数，调用者比较前后两次的值判断是否有缓冲区可用了
+    unsigned long recycledBufs() const {
+        return recycled;
+    }
+
+private:
+    // 用一次recv检查缓冲区环是否可用
+    bool probeBufRing();
+
+    // 通过IORING_OP_PROVIDE_BUFFERS提供从bid开始的nbufs个缓冲区
+    io_uring_sqe* provideBufs(unsigned short bid, unsigned nbufs);
+
+private:
+    // ring的文件描述符
+    int ringFd;
+
+    // 映射的提交队列、完成队列和提交队列项
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    // 提交队列的各个字段
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+
+    // 本地维护的提交队列尾部，提交时才写回内核
+    unsigned sqeTail;
+
+    // 完成队列的各个字段
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+
+    // 提供缓冲区环
+    io_uring_buf_ring* bufRing;
+    size_t bufRingSize;
+    unsigned bufMask;
+    char* bufBase;
+    unsigned bufCount;
+    unsigned bufSize;
+    unsigned short bufGroup;
+
+    // 提交队列已满时未能归还的缓冲区
+    std::vector<unsigned short> unrecycled;
+
+    // 累计归还的缓冲区个数
+    unsigned long recycled;
+};
+
+#endif
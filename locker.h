@@ -2,121 +2,571 @@
 #define LOCKER_H
 
 #include <bits/types/struct_timespec.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <atomic>
 #include <exception>
-#include <pthread.h>
-#include <semaphore.h>
+#include <algorithm>
+#include <vector>
+#include "futex.h"
 
-// 互斥锁类
-class Locker {
+// 锁的竞争统计，只有构造时指定了名字的锁才记录
+// 获取次数在持有锁时更新，等待时间只在发生竞争时计时，不竞争时几乎没有额外开销
+struct LockStats {
+    explicit LockStats(const char* _name) : name(_name), acquired(0), contended(0), waitNs(0) {}
+
+    const char* name;
+    std::atomic<unsigned long> acquired;    // 获取次数
+    std::atomic<unsigned long> contended;   // 需要等待的获取次数
+    std::atomic<uint64_t> waitNs;           // 等待的总时间
+
+    // 记录一次不需要等待的获取，持有互斥锁时调用
+    void hit() {
+        acquired.store(acquired.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // 记录一次等待了waited纳秒的获取
+    void miss(uint64_t waited) {
+        acquired.fetch_add(1, std::memory_order_relaxed);
+        contended.fetch_add(1, std::memory_order_relaxed);
+        waitNs.fetch_add(waited, std::memory_order_relaxed);
+    }
+
+    // 记录一次获取，可由多个读者同时调用
+    void hitShared() {
+        acquired.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 登记和注销，使打印时能找到所有带名字的锁
+    static void add(LockStats* stats);
+    static void remove(LockStats* stats);
+
+    // 按等待总时间从大到小打印所有被获取过的锁
+    static void printAll();
+
+private:
+    // 已登记的统计及保护它的锁，锁本身不记录统计
+    static std::vector<LockStats*>& registry();
+    static std::atomic<uint32_t>& registryLock();
+};
+
+// 自旋是否有意义，只有一个CPU时持有者不可能同时在运行，直接休眠
+inline bool spinUseful() {
+    static const bool useful = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    return useful;
+}
+
+// 按名字创建统计，名字为nullptr时不记录
+inline LockStats* makeLockStats(const char* name) {
+    if (!name) {
+        return nullptr;
+    }
+    LockStats* stats = new LockStats(name);
+    LockStats::add(stats);
+    return stats;
+}
+
+// 注销并释放统计
+inline void freeLockStats(LockStats* stats) {
+    if (stats) {
+        LockStats::remove(stats);
+        delete stats;
+    }
+}
+
+// 自旋锁，只适合临界区极短且不会阻塞的场景，自旋过久时让出CPU
+class SpinLock {
 public:
-    // 构造函数，初始化失败则抛出异常
-    Locker() {
-        if (pthread_mutex_init(&mutex, nullptr) != 0) {
-            throw std::exception();
+    // 自旋多少次后开始让出CPU
+    static const int YIELD_AFTER = 128;
+
+    explicit SpinLock(const char* name = nullptr) : state(0), stats(makeLockStats(name)) {}
+
+    ~SpinLock() {
+        freeLockStats(stats);
+    }
+
+    SpinLock(const SpinLock&) = delete;
+    SpinLock& operator=(const SpinLock&) = delete;
+
+    // 加锁，返回是否加锁成功
+    bool lock() {
+        if (state.exchange(1, std::memory_order_acquire) == 0) {
+            if (stats) {
+                stats->hit();
+            }
+            return true;
+        }
+        uint64_t start = stats ? monotonicNs() : 0;
+        for (int spins = 0; ; spins++) {
+            // 先只读等待锁被释放，避免反复抢占缓存行
+            while (state.load(std::memory_order_relaxed) != 0) {
+                if (++spins >= YIELD_AFTER || !spinUseful()) {
+                    sched_yield();
+                } else {
+                    cpuRelax();
+                }
+            }
+            if (state.exchange(1, std::memory_order_acquire) == 0) {
+                break;
+            }
+        }
+        if (stats) {
+            stats->miss(monotonicNs() - start);
         }
+        return true;
     }
 
-    // 析构函数，销毁互斥锁
+    // 尝试加锁，不等待
+    bool tryLock() {
+        if (state.load(std::memory_order_relaxed) != 0 || state.exchange(1, std::memory_order_acquire) != 0) {
+            return false;
+        }
+        if (stats) {
+            stats->hit();
+        }
+        return true;
+    }
+
+    // 解锁，返回是否解锁成功
+    bool unlock() {
+        state.store(0, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::atomic<uint32_t> state;
+    LockStats* stats;
+};
+
+// 互斥锁类，基于futex实现
+// 状态0为未加锁，1为已加锁且无人休眠，2为已加锁且可能有人休眠；解锁时只有状态为2才需要系统调用
+// 加锁失败时先自旋一段时间再休眠，自旋次数按最近实际需要的次数自适应调整
+class Locker {
+public:
+    // 自旋次数的上限
+    static const int MAX_SPIN = 100;
+
+    // 构造函数，name不为nullptr时记录竞争统计，可用SIGUSR1打印
+    explicit Locker(const char* name = nullptr) : state(0), spinLimit(MAX_SPIN / 2), stats(makeLockStats(name)) {}
+
+    // 析构函数
     ~Locker() {
-        pthread_mutex_destroy(&mutex);
+        freeLockStats(stats);
     }
 
+    Locker(const Locker&) = delete;
+    Locker& operator=(const Locker&) = delete;
+
     // 加锁，返回是否加锁成功
     bool lock() {
-        return pthread_mutex_lock(&mutex) == 0;
+        uint32_t c = 0;
+        if (state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            if (stats) {
+                stats->hit();
+            }
+            return true;
+        }
+        lockSlow();
+        return true;
+    }
+
+    // 尝试加锁，不等待
+    bool tryLock() {
+        uint32_t c = 0;
+        if (!state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return false;
+        }
+        if (stats) {
+            stats->hit();
+        }
+        return true;
     }
 
     // 解锁，返回是否解锁成功
     bool unlock() {
-        return pthread_mutex_unlock(&mutex) == 0;
+        if (state.exchange(0, std::memory_order_release) == 2) {
+            futexWake(&state, 1);
+        }
+        return true;
     }
 
-    // 获取私有的互斥锁地址
-    pthread_mutex_t* get() {
-        return &mutex;
+private:
+    // 加锁的慢路径：自旋，仍失败则把状态置为2并休眠
+    void lockSlow() {
+        uint64_t start = stats ? monotonicNs() : 0;
+        if (spinUseful()) {
+            int limit = std::min(MAX_SPIN, spinLimit.load(std::memory_order_relaxed) * 2 + 10);
+            int spins = 0;
+            for (; spins < limit; spins++) {
+                uint32_t c = 0;
+                if (state.load(std::memory_order_relaxed) == 0 &&
+                    state.compare_exchange_weak(c, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    break;
+                }
+                cpuRelax();
+            }
+            // 按本次实际自旋的次数平滑调整下次的自旋上限
+            int old = spinLimit.load(std::memory_order_relaxed);
+            spinLimit.store(old + (spins - old) / 8, std::memory_order_relaxed);
+            if (spins < limit) {
+                if (stats) {
+                    stats->miss(monotonicNs() - start);
+                }
+                return;
+            }
+        }
+
+        while (state.exchange(2, std::memory_order_acquire) != 0) {
+            futexWait(&state, 2);
+        }
+        if (stats) {
+            stats->miss(monotonicNs() - start);
+        }
     }
 
 private:
-    pthread_mutex_t mutex;
+    std::atomic<uint32_t> state;
+    std::atomic<int> spinLimit;
+    LockStats* stats;
+
+    friend class Cond;
 };
 
-// 条件变量类
-class Cond {
+// 读写锁，基于futex实现，写者优先：有写者在等待时新的读者也会等待
+// 状态字的最高位表示写者持有，次高位表示有写者在等待，其余位为持有锁的读者个数
+class RWLock {
 public:
-    // 构造函数，初始化条件变量失败则抛出异常
-    Cond() {
-        if (pthread_cond_init(&cond, nullptr) != 0) {
-            throw std::exception();
+    // 休眠前自旋的次数
+    static const int SPIN_COUNT = 64;
+
+    explicit RWLock(const char* name = nullptr) : state(0), sleepers(0), stats(makeLockStats(name)) {}
+
+    ~RWLock() {
+        freeLockStats(stats);
+    }
+
+    RWLock(const RWLock&) = delete;
+    RWLock& operator=(const RWLock&) = delete;
+
+    // 加读锁
+    bool readLock() {
+        uint32_t s = state.load(std::memory_order_relaxed);
+        if (!(s & (WRITER | WRITER_WAITING)) &&
+            state.compare_exchange_strong(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            if (stats) {
+                stats->hitShared();
+            }
+            return true;
+        }
+
+        uint64_t start = stats ? monotonicNs() : 0;
+        for (int spins = 0; ; spins++) {
+            s = state.load(std::memory_order_relaxed);
+            if (!(s & (WRITER | WRITER_WAITING))) {
+                if (state.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    break;
+                }
+                continue;
+            }
+            if (spins < SPIN_COUNT && spinUseful()) {
+                cpuRelax();
+            } else {
+                sleep(s);
+            }
+        }
+        if (stats) {
+            stats->miss(monotonicNs() - start);
+        }
+        return true;
+    }
+
+    // 解读锁，最后一个读者离开时唤醒等待的写者
+    // 改变状态和读sleepers都是seq_cst，不会与休眠方的登记和检查交错成双方都没看到对方
+    bool readUnlock() {
+        uint32_t s = state.fetch_sub(1, std::memory_order_seq_cst) - 1;
+        if ((s & READERS) == 0 && sleepers.load(std::memory_order_seq_cst) != 0) {
+            futexWake(&state, 0x7fffffff);
         }
+        return true;
     }
 
-    // 析构函数，销毁条件变量
-    ~Cond() {
-        pthread_cond_destroy(&cond);
+    // 加写锁
+    bool writeLock() {
+        uint32_t s = 0;
+        if (state.compare_exchange_strong(s, WRITER, std::memory_order_acquire, std::memory_order_relaxed)) {
+            if (stats) {
+                stats->hit();
+            }
+            return true;
+        }
+
+        uint64_t start = stats ? monotonicNs() : 0;
+        for (int spins = 0; ; spins++) {
+            s = state.load(std::memory_order_relaxed);
+            if (!(s & (WRITER | READERS))) {
+                // 等待位一并清除，其他仍在等待的写者醒来后会重新设置
+                if (state.compare_exchange_weak(s, WRITER, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    break;
+                }
+                continue;
+            }
+            if (!(s & WRITER_WAITING)) {
+                // 阻止新的读者进入
+                state.fetch_or(WRITER_WAITING, std::memory_order_relaxed);
+                continue;
+            }
+            if (spins < SPIN_COUNT && spinUseful()) {
+                cpuRelax();
+            } else {
+                sleep(s);
+            }
+        }
+        if (stats) {
+            stats->miss(monotonicNs() - start);
+        }
+        return true;
     }
 
-    // 等待条件变量，需要先加锁
-    bool wait(pthread_mutex_t* mutex) {
-        int ret = 0;
-        ret = pthread_cond_wait(&cond, mutex);
-        return ret == 0;
+    // 解写锁，唤醒所有等待者重新竞争
+    // 用seq_cst的exchange，release的store可能被重排到之后读sleepers之后，休眠方会错过唤醒
+    bool writeUnlock() {
+        state.exchange(0, std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) != 0) {
+            futexWake(&state, 0x7fffffff);
+        }
+        return true;
     }
 
-    // 等待条件变量一段时间，需要先加锁
-    bool timewait(pthread_mutex_t* mutex, struct timespec t) {
-        int ret = 0;
-        ret = pthread_cond_timedwait(&cond, mutex, &t);
-        return ret == 0;
+private:
+    static const uint32_t WRITER = 1u << 31;
+    static const uint32_t WRITER_WAITING = 1u << 30;
+    static const uint32_t READERS = WRITER_WAITING - 1;
+
+    // 状态仍为s时休眠，解锁方在改变状态后检查sleepers决定是否唤醒
+    void sleep(uint32_t s) {
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        if (state.load(std::memory_order_seq_cst) == s) {
+            futexWait(&state, s);
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> state;
+    std::atomic<int> sleepers;
+    LockStats* stats;
+};
+
+// 条件变量类，基于futex实现，用序号检测等待期间是否有通知
+class Cond {
+public:
+    Cond() : seq(0), waiters(0) {}
+
+    Cond(const Cond&) = delete;
+    Cond& operator=(const Cond&) = delete;
+
+    // 等待条件变量，需要先加锁，可能虚假唤醒，调用者应循环检查条件
+    bool wait(Locker& locker) {
+        return waitFor(locker, nullptr);
+    }
+
+    // 等待条件变量直到绝对时间t（CLOCK_REALTIME），需要先加锁，超时返回false
+    bool timewait(Locker& locker, struct timespec t) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        struct timespec rel;
+        rel.tv_sec = t.tv_sec - now.tv_sec;
+        rel.tv_nsec = t.tv_nsec - now.tv_nsec;
+        if (rel.tv_nsec < 0) {
+            rel.tv_sec--;
+            rel.tv_nsec += 1000000000L;
+        }
+        if (rel.tv_sec < 0) {
+            return false;
+        }
+        return waitFor(locker, &rel);
     }
 
     // 唤醒一个在等待此条件变量的线程
     bool signal() {
-        return pthread_cond_signal(&cond) == 0;
+        seq.fetch_add(1, std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) != 0) {
+            futexWake(&seq, 1);
+        }
+        return true;
     }
 
     // 唤醒全部在等待此条件变量的线程
     bool broadcast() {
-        return pthread_cond_broadcast(&cond) == 0;
+        seq.fetch_add(1, std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) != 0) {
+            futexWake(&seq, 0x7fffffff);
+        }
+        return true;
     }
 
 private:
-    pthread_cond_t cond;
+    // 记下序号后解锁并休眠，序号已变化说明解锁后有过通知，立即返回
+    bool waitFor(Locker& locker, const struct timespec* timeout) {
+        uint32_t s = seq.load(std::memory_order_seq_cst);
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        locker.unlock();
+        int ret = futexWait(&seq, s, timeout);
+        int err = errno;
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+
+        // 醒来时可能有其他被唤醒的线程在争锁，按有人休眠加锁，解锁时不会漏掉唤醒
+        while (locker.state.exchange(2, std::memory_order_acquire) != 0) {
+            futexWait(&locker.state, 2);
+        }
+        return !(ret != 0 && err == ETIMEDOUT);
+    }
+
+private:
+    std::atomic<uint32_t> seq;
+    std::atomic<int> waiters;
 };
 
-// 信号量类
+// 信号量类，基于futex实现，计数为0时才休眠
 class Sem {
 public:
-    // 默认构造函数，初始化信号量
-    Sem() {
-        if (sem_init(&sem, 0, 0) != 0) {
-            throw std::exception();
+    // 休眠前自旋的次数
+    static const int SPIN_COUNT = 64;
+
+    // 构造函数，初始化的信号量为n
+    explicit Sem(int n = 0) : value(n), waiters(0) {}
+
+    Sem(const Sem&) = delete;
+    Sem& operator=(const Sem&) = delete;
+
+    // 增加信号量，有线程在等待时唤醒一个
+    bool post() {
+        value.fetch_add(1, std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) != 0) {
+            futexWake(&value, 1);
         }
+        return true;
     }
 
-    // 重载构造函数，初始化的信号量为n
-    Sem(int n) {
-        if (sem_init(&sem, 0, n) != 0) {
-            throw std::exception();
+    // 减少信号量，为0时等待
+    bool wait() {
+        for (int spins = 0; spins < SPIN_COUNT && spinUseful(); spins++) {
+            if (tryWait()) {
+                return true;
+            }
+            cpuRelax();
         }
+        while (!tryWait()) {
+            waiters.fetch_add(1, std::memory_order_seq_cst);
+            if (value.load(std::memory_order_seq_cst) == 0) {
+                futexWait(&value, 0);
+            }
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return true;
     }
 
-    // 析构函数
-    ~Sem() {
-        sem_destroy(&sem);
+    // 信号量大于0时减少并返回true，否则立即返回false
+    bool tryWait() {
+        uint32_t v = value.load(std::memory_order_relaxed);
+        while (v > 0) {
+            if (value.compare_exchange_weak(v, v - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
     }
 
-    // 增加信号量
-    bool post() {
-        return sem_post(&sem) == 0;
+private:
+    std::atomic<uint32_t> value;
+    std::atomic<int> waiters;
+};
+
+// 已登记的统计
+inline std::vector<LockStats*>& LockStats::registry() {
+    static std::vector<LockStats*> stats;
+    return stats;
+}
+
+// 保护登记表的锁，只在锁的构造、析构和打印时使用
+inline std::atomic<uint32_t>& LockStats::registryLock() {
+    static std::atomic<uint32_t> state(0);
+    return state;
+}
+
+// 登记
+inline void LockStats::add(LockStats* stats) {
+    while (registryLock().exchange(1, std::memory_order_acquire) != 0) {
+        sched_yield();
     }
+    registry().push_back(stats);
+    registryLock().store(0, std::memory_order_release);
+}
 
-    // 减少信号量
-    bool wait() {
-        return sem_wait(&sem) == 0;
+// 注销
+inline void LockStats::remove(LockStats* stats) {
+    while (registryLock().exchange(1, std::memory_order_acquire) != 0) {
+        sched_yield();
     }
+    std::vector<LockStats*>& all = registry();
+    all.erase(std::remove(all.begin(), all.end(), stats), all.end());
+    registryLock().store(0, std::memory_order_release);
+}
 
-private:
-    sem_t sem;
-};
+// 按等待总时间从大到小打印所有被获取过的锁，同名的锁（如分片锁）合并为一行
+inline void LockStats::printAll() {
+    while (registryLock().exchange(1, std::memory_order_acquire) != 0) {
+        sched_yield();
+    }
+    struct Total {
+        const char* name;
+        int locks;
+        unsigned long acquired;
+        unsigned long contended;
+        uint64_t waitNs;
+    };
+    std::vector<Total> totals;
+    const std::vector<LockStats*>& all = registry();
+    for (size_t i = 0; i < all.size(); i++) {
+        size_t j = 0;
+        while (j < totals.size() && strcmp(totals[j].name, all[i]->name) != 0) {
+            j++;
+        }
+        if (j == totals.size()) {
+            totals.push_back(Total{all[i]->name, 0, 0, 0, 0});
+        }
+        totals[j].locks++;
+        totals[j].acquired += all[i]->acquired.load(std::memory_order_relaxed);
+        totals[j].contended += all[i]->contended.load(std::memory_order_relaxed);
+        totals[j].waitNs += all[i]->waitNs.load(std::memory_order_relaxed);
+    }
+    registryLock().store(0, std::memory_order_release);
+
+    std::sort(totals.begin(), totals.end(), [](const Total& a, const Total& b) {
+        return a.waitNs > b.waitNs;
+    });
+    printf("locks:\n");
+    for (size_t i = 0; i < totals.size(); i++) {
+        const Total& t = totals[i];
+        if (t.acquired == 0) {
+            continue;
+        }
+        char name[32];
+        if (t.locks > 1) {
+            snprintf(name, sizeof(name), "%s x%d", t.name, t.locks);
+        } else {
+            snprintf(name, sizeof(name), "%s", t.name);
+        }
+        printf("    %-16s acquired %lu, contended %lu (%.2f%%), wait %.3f ms total, %.2f us avg\n",
+               name, t.acquired, t.contended, t.contended * 100.0 / t.acquired,
+               t.waitNs / 1e6, t.contended ? t.waitNs / 1e3 / t.contended : 0.0);
+    }
+}
 
-#endif
\ No newline at end of file
+#endif
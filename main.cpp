@@ -8,19 +8,54 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/epoll.h>
+#include <limits>
+#include <vector>
 #include "locker.h"
 #include "threadpool.h"
 #include "httpConn.h"
+#include "reactor.h"
+#include "config.h"
+#include "affinity.h"
+#include "httpScanner.h"
+#include "fileCache.h"
+#include "bundle.h"
 
-// 最大的文件描述符个数
-#define MAX_FD 65536   
+// 所有的反应堆
+static std::vector<Reactor*> reactors;
 
-// 监听的最大的事件数量
-#define MAX_EVENT_NUMBER 10000  
+// 处理请求的线程池
+static ThreadPool<HTTPConn>* pool = nullptr;
 
-// 添加文件描述符
-extern void addfd(int epollfd, int fd, bool one_shot);
-extern void removefd(int epollfd, int fd);
+// 网站的根目录，定义在httpConn.cpp中
+extern const char* docRoot;
+
+// 收到SIGUSR1后置位，由下一个醒来的反应堆打印统计信息
+volatile sig_atomic_t statsRequested = 0;
+
+// SIGUSR1的处理函数
+void statsHandler(int) {
+    statsRequested = 1;
+}
+
+// 打印所有反应堆的统计信息
+void printServerStats() {
+    printf("users: %d\n", HTTPConn::userCount.load());
+    HTTPConn::IOBufferPool::printStats();
+    pool->printStats();
+    HTTPConn::fileCache->printStats();
+    LockStats::printAll();
+    for (size_t i = 0; i < reactors.size(); i++) {
+        reactors[i]->printStats();
+    }
+    fflush(stdout);
+}
+
+// 打印用法
+static void usage(const char* prog) {
+    printf("usage: %s [-r reactor_num] [-b listen_backlog] [-a accept_budget] [-c max_conns] [-i epoll|uring] [-t min_threads[:max_threads]] [-m max_requests] [-w] [-q shed_target_ms]\n", prog);
+    printf("       [-p compact|scatter|cpu_list] [-d doc_root] [-s mmap|sendfile|splice[:threshold_kb]] [-f file_cache_size]\n");
+    printf("       [-P render_limit_kb[:render_budget_mb]] [-z compress_limit_kb[:compress_budget_mb]] [-o io_threads] [-L preload_mb] [-B bundle_file] port_number\n");
+}
 
 // 添加信号处理函数
 void addsig(int sig, void(handler)(int)) {
@@ -32,99 +67,252 @@ void addsig(int sig, void(handler)(int)) {
 }
 
 int main(int argc, char* argv[]) { 
-    if(argc <= 1) {
-        printf( "usage: %s port_number\n", basename(argv[0]));
+    uint64_t startNs = monotonicNs();
+    ServerConfig config;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:a:c:i:t:m:wq:p:d:s:f:P:z:o:L:B:")) != -1) {
+        switch (opt) {
+            case 'r':
+                config.reactorNums = atoi(optarg);
+                break;
+            case 'b':
+                config.backlog = atoi(optarg);
+                break;
+            case 'a':
+                config.acceptBudget = atoi(optarg);
+                break;
+            case 'c':
+                config.maxConns = atoi(optarg);
+                break;
+            case 'i':
+                if (strcmp(optarg, "uring") == 0) {
+                    config.ioBackend = IO_URING;
+                } else if (strcmp(optarg, "epoll") == 0) {
+                    config.ioBackend = IO_EPOLL;
+                } else {
+                    usage(basename(argv[0]));
+                    return 1;
+                }
+                break;
+            case 't': {
+                // 只给出一个数时线程数固定，要求1 <= min <= max
+                int n = sscanf(optarg, "%d:%d", &config.minThreads, &config.maxThreads);
+                if (n == 1) {
+                    config.maxThreads = config.minThreads;
+                }
+                if (n < 1 || config.minThreads < 1 || config.minThreads > config.maxThreads) {
+                    usage(basename(argv[0]));
+                    return 1;
+                }
+                break;
+            }
+            case 'm':
+                config.maxRequests = atoi(optarg);
+                break;
+            case 'w':
+                config.workStealing = true;
+                break;
+            case 'q':
+                config.shedTargetMs = atoi(optarg);
+                break;
+            case 'p':
+                // compact和scatter之外的参数视为CPU列表，如0,2,4-7
+                if (strcmp(optarg, "compact") == 0) {
+                    config.affinity = AFFINITY_COMPACT;
+                } else if (strcmp(optarg, "scatter") == 0) {
+                    config.affinity = AFFINITY_SCATTER;
+                } else {
+                    config.affinity = AFFINITY_LIST;
+                    config.cpuList = optarg;
+                }
+                break;
+            case 'd':
+                config.docRoot = optarg;
+                break;
+            case 's': {
+                // 可以在方式后给出阈值，单位为KB，如sendfile:16，0表示所有非空文件都按该方式发送
+                char mode[16];
+                long thresholdKb = -1;
+                if (sscanf(optarg, "%15[a-z]:%ld", mode, &thresholdKb) < 1) {
+                    mode[0] = '\0';
+                }
+                if (strcmp(mode, "mmap") == 0) {
+                    config.fileSend = SEND_MMAP;
+                } else if (strcmp(mode, "sendfile") == 0) {
+                    config.fileSend = SEND_SENDFILE;
+                } else if (strcmp(mode, "splice") == 0) {
+                    config.fileSend = SEND_SPLICE;
+                } else {
+                    usage(basename(argv[0]));
+                    return 1;
+                }
+                if (thresholdKb >= 0) {
+                    config.fileSendThreshold = thresholdKb * 1024;
+                }
+                break;
+            }
+            case 'f':
+                config.fileCacheSize = atoi(optarg);
+                break;
+            case 'L':
+                config.preloadBytes = atol(optarg) * 1024 * 1024;
+                break;
+            case 'B':
+                config.bundlePath = optarg;
+                break;
+            case 'o':
+                config.ioThreads = atoi(optarg);
+                break;
+            case 'P': {
+                // 预先渲染响应的文件大小上限，单位为KB，为负时不渲染，可以再给出内存预算，单位为MB
+                long limitKb = 0, budgetMb = -1;
+                if (sscanf(optarg, "%ld:%ld", &limitKb, &budgetMb) < 1) {
+                    usage(basename(argv[0]));
+                    return 1;
+                }
+                config.renderLimit = limitKb < 0 ? -1 : limitKb * 1024;
+                if (budgetMb >= 0) {
+                    config.renderBudget = budgetMb * 1024 * 1024;
+                }
+                break;
+            }
+            case 'z': {
+                // 后台压缩的文件大小上限，单位为KB，为负时不压缩，可以再给出内存预算，单位为MB
+                long limitKb = 0, budgetMb = -1;
+                if (sscanf(optarg, "%ld:%ld", &limitKb, &budgetMb) < 1) {
+                    usage(basename(argv[0]));
+                    return 1;
+                }
+                config.compressLimit = limitKb < 0 ? -1 : limitKb * 1024;
+                if (budgetMb >= 0) {
+                    config.compressBudget = budgetMb * 1024 * 1024;
+                }
+                break;
+            }
+            default:
+                usage(basename(argv[0]));
+                return 1;
+        }
+    }
+
+    if(optind >= argc || config.reactorNums <= 0 || config.backlog <= 0 || config.acceptBudget <= 0 ||
+       config.maxConns <= 0 || config.shedTargetMs < 0 || config.fileCacheSize < 0 || config.ioThreads < 0 || config.preloadBytes < 0 ||
+       config.minThreads < 0 || config.maxThreads < 0 || config.maxRequests < 0) {
+        usage(basename(argv[0]));
         return 1;
     }
 
-    int port = atoi(argv[1]);
+    config.port = atoi(argv[optind]);
+    if (config.docRoot) {
+        docRoot = config.docRoot;
+    }
+    HTTPConn::fileSend = config.fileSend;
     addsig(SIGPIPE, SIG_IGN);
 
-    // 初始化线程池
-    ThreadPool<HTTPConn>* pool = nullptr;
+    // kill -USR1打印统计信息
+    addsig(SIGUSR1, statsHandler);
+
+    // 按策略排出反应堆和工作线程使用的CPU
+    CpuLayout* layout = nullptr;
     try {
-        pool = new ThreadPool<HTTPConn>;
+        layout = new CpuLayout(config.affinity, config.cpuList, config.reactorNums);
     } catch( ... ) {
+        printf("invalid cpu list: %s\n", config.cpuList);
         return 1;
     }
 
-    // 初始化客户数组
-    HTTPConn* users = new HTTPConn[MAX_FD];
-
-    // 创建用于监听的socket
-    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    // 初始化线程池
+    try {
+        pool = new ThreadPool<HTTPConn>(config.minThreads, config.maxThreads, config.maxRequests,
+                                        config.workStealing, config.shedTargetMs, 100, layout->workerCpus());
+    } catch( ... ) {
+        return 1;
+    }
+    layout->printReport(pool->threadLimit());
+    printf("request scanner: %s\n", scannerName());
 
-    int ret = 0;
-    struct sockaddr_in address;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_family = AF_INET;
-    address.sin_port = htons(port);
+    // 预读冷文件的I/O线程池，只执行后台任务，不丢弃
+    if (config.ioThreads > 0) {
+        try {
+            HTTPConn::ioPool = new ThreadPool<HTTPConn>(config.ioThreads, config.ioThreads, 0, false, 0);
+        } catch( ... ) {
+            return 1;
+        }
+    }
 
-    // 端口复用
-    int reuse = 1;
-    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-    ret = bind(listenfd, (struct sockaddr*)&address, sizeof(address));
+    // 创建文件缓存，小于阈值的文件映射到内存，io_uring后端没有sendfile操作，所有文件都映射
+    off_t mapThreshold = config.fileSendThreshold;
+    if (config.fileSend == SEND_MMAP || config.ioBackend == IO_URING) {
+        mapThreshold = std::numeric_limits<off_t>::max();
+    }
+    try {
+        HTTPConn::fileCache = new FileCache(docRoot, config.fileCacheSize, mapThreshold,
+                                             config.renderLimit, config.renderBudget,
+                                             config.compressLimit, config.compressBudget);
+    } catch( ... ) {
+        printf("create file cache failed, errno is: %d\n", errno);
+        return 1;
+    }
 
-    // 监听，最大连接请求数为5
-    ret = listen(listenfd, 5);
+    // 映射静态资源包，全部页面在此读入，之后的请求不访问文件系统
+    if (config.bundlePath) {
+        uint64_t bundleStart = monotonicNs();
+        try {
+            HTTPConn::bundle = new Bundle(config.bundlePath);
+        } catch( ... ) {
+            printf("load bundle %s failed, errno is: %d\n", config.bundlePath, errno);
+            return 1;
+        }
+        printf("bundle: %u files (%.1f MB) mapped in %.1f ms\n", HTTPConn::bundle->count(),
+               HTTPConn::bundle->bytes() / 1048576.0, (monotonicNs() - bundleStart) / 1e6);
+    }
 
-    // 创建epoll对象和事件数组
-    epoll_event events[MAX_EVENT_NUMBER];
-    int epollfd = epoll_create(5);
+    // 预热文件缓存，完成后才创建监听socket，第一个请求就能命中已在内存中的文件
+    if (config.preloadBytes > 0 && !config.bundlePath) {
+        uint64_t preloadStart = monotonicNs();
+        uint64_t bytes = 0;
+        int files = HTTPConn::fileCache->preload(config.preloadBytes, std::max(config.ioThreads, 1), bytes);
+        printf("preloaded %d files (%.1f MB) in %.1f ms\n", files, bytes / 1048576.0, (monotonicNs() - preloadStart) / 1e6);
+    }
 
-    // 添加到epoll对象中
-    addfd(epollfd, listenfd, false);
-    HTTPConn::epollFd = epollfd;
+    if (config.fileSend == SEND_MMAP || config.ioBackend == IO_URING) {
+        printf("file send: mmap\n");
+    } else {
+        printf("file send: %s for files >= %ld bytes\n", config.fileSend == SEND_SPLICE ? "splice" : "sendfile",
+               config.fileSendThreshold);
+    }
 
-    while(true) {
-        int number = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);
-  
-        if ((number < 0) && (errno != EINTR)) {
-            printf("epoll failure\n");
-            break;
+    // 创建反应堆，多个反应堆时每个都有自己的SO_REUSEPORT监听socket
+    try {
+        for (int i = 0; i < config.reactorNums; i++) {
+            int cpu = layout->reactorCpu(i);
+            reactors.push_back(new Reactor(i, config, pool, cpu, layout->nodeOf(cpu)));
         }
+    } catch( ... ) {
+        printf("create reactor failed, errno is: %d\n", errno);
+        return 1;
+    }
 
-        for (int i = 0; i < number; i++) {
-            int sockfd = events[i].data.fd;
-            
-            if(sockfd == listenfd) {
-                struct sockaddr_in client_address;
-                socklen_t client_addrlength = sizeof(client_address);
-                int connfd = accept(listenfd, (struct sockaddr*)&client_address, &client_addrlength);
-                
-                if (connfd < 0) {
-                    printf("errno is: %d\n", errno);
-                    continue;
-                } 
-
-                if(HTTPConn::userCount >= MAX_FD) {
-                    close(connfd);
-                    continue;
-                }
-                users[connfd].init(connfd, client_address);
-
-            } else if(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                users[sockfd].closeConn();
-
-            } else if(events[i].events & EPOLLIN) {
-                if(users[sockfd].read()) {
-                    pool->appendRequest(users + sockfd);
+    printf("ready in %.1f ms\n", (monotonicNs() - startNs) / 1e6);
+    fflush(stdout);
 
-                } else {
-                    users[sockfd].closeConn();
-                }
+    // 第0个反应堆运行在主线程中，其余的各自运行在一个新线程中
+    for (int i = 1; i < config.reactorNums; i++) {
+        reactors[i]->start();
+    }
+    reactors[0]->loop();
+    for (int i = 1; i < config.reactorNums; i++) {
+        reactors[i]->join();
+    }
 
-            }  else if(events[i].events & EPOLLOUT) {
-                if(!users[sockfd].write()) {
-                    users[sockfd].closeConn();
-                }
-            }
-        }
+    for (int i = 0; i < config.reactorNums; i++) {
+        delete reactors[i];
     }
-    
-    close(epollfd);
-    close(listenfd);
-    delete [] users;
     delete pool;
+    delete HTTPConn::ioPool;
+    delete HTTPConn::fileCache;
+    delete HTTPConn::bundle;
+    delete layout;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#ifndef MPMCQUEUE_H
+#define MPMCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+// 有界的无锁多生产者多消费者队列，基于环形数组，每个槽位带一个序号
+// 序号等于入队位置时可写入，等于入队位置加一时可读出，生产者和消费者只在各自的下标上竞争
+template <typename T>
+class MPMCQueue {
+public:
+    // 构造函数，容量向上取整为2的幂
+    MPMCQueue(size_t _capacity);
+
+    // 析构函数
+    ~MPMCQueue();
+
+    // 入队，队列已满返回false，此时value保持不变
+    bool push(const T& value) {
+        T copy(value);
+        return push(std::move(copy));
+    }
+    bool push(T&& value);
+
+    // 出队，队列为空返回false，元素被移动到value中
+    bool pop(T& value);
+
+    // 队列中元素个数的近似值
+    size_t size() const;
+
+    // 队列的容量
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    // 槽位，按缓存行对齐以避免伪共享
+    struct alignas(64) Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    Cell* cells;
+    size_t mask;
+
+    // 入队和出队的位置，各占一个缓存行
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+};
+
+// 构造函数
+template <typename T>
+MPMCQueue<T>::MPMCQueue(size_t _capacity) : enqueuePos(0), dequeuePos(0) {
+    if (_capacity == 0) {
+        throw std::exception();
+    }
+    size_t cap = 1;
+    while (cap < _capacity) {
+        cap <<= 1;
+    }
+    mask = cap - 1;
+    cells = new Cell[cap];
+    for (size_t i = 0; i < cap; i++) {
+        cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+// 析构函数
+template <typename T>
+MPMCQueue<T>::~MPMCQueue() {
+    delete [] cells;
+}
+
+// 入队
+template <typename T>
+bool MPMCQueue<T>::push(T&& value) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            // 槽位空闲，抢占入队位置
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // 槽位还未被消费，队列已满
+            return false;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->data = std::move(value);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+// 出队
+template <typename T>
+bool MPMCQueue<T>::pop(T& value) {
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            // 槽位已写入，抢占出队位置
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // 槽位还未被写入，队列为空
+            return false;
+        } else {
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+    value = std::move(cell->data);
+    cell->seq.store(pos + mask + 1, std::memory_order_release);
+    return true;
+}
+
+// 队列中元素个数的近似值
+template <typename T>
+size_t MPMCQueue<T>::size() const {
+    size_t tail = enqueuePos.load(std::memory_order_relaxed);
+    size_t head = dequeuePos.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+#endif
@@ -0,0 +1,205 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "outputQueue.h"
+
+// 追加一段数据
+void OutputQueue::push(const void* base, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    pending += len;
+    if (!empty() && files.back().fd >= 0) {
+        dataAfterFile = true;
+    }
+    if (!empty() && files.back().fd < 0) {
+        struct iovec& last = segs.back();
+        if ((const char*)last.iov_base + last.iov_len == (const char*)base) {
+            last.iov_len += len;
+            return;
+        }
+    }
+    struct iovec seg;
+    seg.iov_base = (void*)base;
+    seg.iov_len = len;
+    segs.push_back(seg);
+    files.push_back(FileRef{-1, 0, false});
+}
+
+// 追加一个文件段
+void OutputQueue::pushFile(int fd, off_t offset, size_t len, bool splice) {
+    if (len == 0) {
+        return;
+    }
+    pending += len;
+    if (!empty() && files.back().fd >= 0) {
+        dataAfterFile = true;
+    }
+    struct iovec seg;
+    seg.iov_base = nullptr;
+    seg.iov_len = len;
+    segs.push_back(seg);
+    files.push_back(FileRef{fd, offset, splice});
+}
+
+// 尚未发送的内存段
+const struct iovec* OutputQueue::segments(int& count) const {
+    size_t n = 0;
+    while (head + n < segs.size() && n < IOV_MAX && files[head + n].fd < 0) {
+        n++;
+    }
+    count = (int)n;
+    return segs.data() + head;
+}
+
+// 已发出n字节
+void OutputQueue::consume(size_t n) {
+    pending -= n;
+    while (n > 0 && head < segs.size()) {
+        struct iovec& seg = segs[head];
+        if (n < seg.iov_len) {
+            if (files[head].fd >= 0) {
+                files[head].offset += n;
+            } else {
+                seg.iov_base = (char*)seg.iov_base + n;
+            }
+            seg.iov_len -= n;
+            return;
+        }
+        n -= seg.iov_len;
+        head++;
+    }
+}
+
+// 清空
+void OutputQueue::clear() {
+    segs.clear();
+    files.clear();
+    head = 0;
+    pending = 0;
+    dataAfterFile = false;
+
+    // 管道中残留着未发出的文件内容，不能留给下一个响应，关闭后在下次使用时重新创建
+    if (pipeBytes > 0) {
+        release();
+    }
+}
+
+// 清空并关闭管道
+void OutputQueue::release() {
+    segs.clear();
+    files.clear();
+    head = 0;
+    pending = 0;
+    dataAfterFile = false;
+    pipeBytes = 0;
+    if (pipeFds[0] >= 0) {
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        pipeFds[0] = pipeFds[1] = -1;
+    }
+}
+
+// 发送内存段，其后紧跟文件段时带MSG_MORE，内核等文件内容到来后再组成TCP段
+ssize_t OutputQueue::sendMemory(int sock) {
+    int count = 0;
+    const struct iovec* iov = segments(count);
+    if (head + count == segs.size()) {
+        return writev(sock, iov, count);
+    }
+    struct msghdr msg = {};
+    msg.msg_iov = (struct iovec*)iov;
+    msg.msg_iovlen = count;
+    return sendmsg(sock, &msg, MSG_MORE);
+}
+
+// 用sendfile从页缓存直接发送
+ssize_t OutputQueue::sendFile(int sock, size_t limit) {
+    FileRef& file = files[head];
+    size_t len = segs[head].iov_len < limit ? segs[head].iov_len : limit;
+    off_t offset = file.offset;
+    ssize_t n = sendfile(sock, file.fd, &offset, len);
+    if (n == 0) {
+        // 文件在发送期间被截短，已发出的Content-Length无法兑现
+        errno = EIO;
+        return -1;
+    }
+    return n;
+}
+
+// 文件内容先splice进管道，再从管道splice到socket，管道中的页面只是引用，不复制
+ssize_t OutputQueue::spliceFile(int sock, size_t limit) {
+    if (pipeFds[0] < 0 && pipe2(pipeFds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        return -1;
+    }
+    FileRef& file = files[head];
+    size_t len = segs[head].iov_len < limit ? segs[head].iov_len : limit;
+    if (pipeBytes < len) {
+        loff_t offset = file.offset + pipeBytes;
+        ssize_t n = splice(file.fd, &offset, pipeFds[1], nullptr, len - pipeBytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            pipeBytes += n;
+        } else if (n == 0 || errno != EAGAIN) {
+            // 管道已满时返回EAGAIN，先把管道中的内容发出去
+            if (n == 0) {
+                errno = EIO;
+            }
+            if (pipeBytes == 0) {
+                return -1;
+            }
+        }
+    }
+    // 文件还有内容没读入管道时带SPLICE_F_MORE，与MSG_MORE相同
+    unsigned flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK | (segs[head].iov_len > pipeBytes ? SPLICE_F_MORE : 0);
+    ssize_t n = splice(pipeFds[0], nullptr, sock, nullptr, pipeBytes, flags);
+    if (n > 0) {
+        pipeBytes -= n;
+    }
+    return n;
+}
+
+// 依次发送内存段和文件段
+int OutputQueue::flush(int fd, uint64_t budget) {
+    int on = 1;
+    bool cork = dataAfterFile && setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on)) == 0;
+    int ret = send(fd, budget);
+    if (cork) {
+        // 取消TCP_CORK时内核立即发出剩余的不满一个MSS的数据
+        int off = 0;
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+    return ret;
+}
+
+// 发送，直到发送完、socket缓冲区已满或本次已发送了budget字节
+int OutputQueue::send(int fd, uint64_t budget) {
+    uint64_t sent = 0;
+    while (!empty()) {
+        if (sent >= budget) {
+            return 0;
+        }
+        ssize_t n;
+        const FileRef& file = files[head];
+        if (file.fd < 0) {
+            n = sendMemory(fd);
+        } else if (file.splice) {
+            n = spliceFile(fd, budget - sent);
+        } else {
+            n = sendFile(fd, budget - sent);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        consume(n);
+        sent += n;
+    }
+    return 1;
+}
@@ -0,0 +1,110 @@
+#ifndef OUTPUTQUEUE_H
+#define OUTPUTQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+// 连接的发送队列，由指向头部、文件内容、错误页面等的内存段，以及由sendfile或splice发送的文件段组成，不复制数据
+// 相邻的内存段用尽量少的writev发出，每次最多IOV_MAX段，部分发送时从停下的字节继续
+// 文件段之前的内存段带MSG_MORE发送，头部与文件的开头合并在同一个TCP段中
+// 文件段之后还有数据时（流水线中的多个响应），发送期间设置TCP_CORK，避免文件末尾的小段被Nagle算法扣留到对方的延迟确认
+class OutputQueue {
+public:
+    OutputQueue() : head(0), pending(0), dataAfterFile(false), pipeBytes(0) {
+        pipeFds[0] = pipeFds[1] = -1;
+    }
+    ~OutputQueue() {
+        release();
+    }
+
+    // 追加一段数据，与上一段在内存中相连时合并为一段，数据在发送完之前必须有效
+    void push(const void* base, size_t len);
+
+    // 追加文件fd中从offset开始的len字节，splice为true时经管道用splice发送，否则用sendfile发送
+    // fd由调用者在发送完之后关闭
+    void pushFile(int fd, off_t offset, size_t len, bool splice);
+
+    // 是否已全部发送
+    bool empty() const {
+        return head == segs.size();
+    }
+
+    // 尚未发送的字节数
+    uint64_t bytes() const {
+        return pending;
+    }
+
+    // 尚未发送的内存段，count最多为IOV_MAX，供io_uring的sendmsg使用，在consume()之前有效
+    // io_uring后端不使用文件段，遇到文件段时count在其之前截止，队首是文件段时count为0
+    const struct iovec* segments(int& count) const;
+
+    // 依次访问尚未发送的前limit字节所在的段，f(seg, fd, offset)对内存段fd为-1，返回false时停止
+    template <typename F>
+    void visit(uint64_t limit, F f) const {
+        uint64_t covered = 0;
+        for (size_t i = head; i < segs.size() && covered < limit; i++) {
+            if (!f(segs[i], files[i].fd, files[i].offset)) {
+                return;
+            }
+            covered += segs[i].iov_len;
+        }
+    }
+
+    // 已发出n字节，越过发送完的段，并调整部分发送的段的起点
+    void consume(size_t n);
+
+    // 在非阻塞的fd上发送，直到发送完、socket缓冲区已满或本次已发送了budget字节
+    // 返回1表示已全部发送，0表示还有数据需要等待下一次可写再发送，-1表示出错
+    int flush(int fd, uint64_t budget);
+
+    // 清空，保留已分配的空间供下一批响应使用
+    void clear();
+
+    // 连接关闭时清空并关闭管道，空闲的连接对象不占用fd
+    void release();
+
+private:
+    // 文件段的来源，内存段的fd为-1
+    struct FileRef {
+        int fd;
+        off_t offset;
+        bool splice;
+    };
+
+    // flush()的发送循环
+    int send(int fd, uint64_t budget);
+
+    // 发送从head开始的内存段
+    ssize_t sendMemory(int sock);
+
+    // 用sendfile发送head处的文件段，最多limit字节
+    ssize_t sendFile(int sock, size_t limit);
+
+    // 用splice经管道发送head处的文件段，最多limit字节
+    ssize_t spliceFile(int sock, size_t limit);
+
+    // 文件段的iov_base为nullptr，iov_len为尚未发送的字节数
+    std::vector<struct iovec> segs;
+
+    // 与segs一一对应
+    std::vector<FileRef> files;
+
+    // 第一个尚未发送完的段
+    size_t head;
+
+    uint64_t pending;
+
+    // 文件段之后是否还追加了数据
+    bool dataAfterFile;
+
+    // splice使用的管道，第一次使用时创建，连接关闭前一直复用
+    int pipeFds[2];
+
+    // 已读入管道、尚未发到socket的字节数，属于head处的文件段
+    size_t pipeBytes;
+};
+
+#endif
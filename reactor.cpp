@@ -0,0 +1,773 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <exception>
+#include <sys/eventfd.h>
+#include "reactor.h"
+#include "affinity.h"
+
+// 添加文件描述符
+extern void addfd(int epollfd, int fd, bool one_shot);
+
+// 收到SIGUSR1后置位，由下一个醒来的反应堆打印统计信息
+extern volatile sig_atomic_t statsRequested;
+extern void printServerStats();
+
+// 构造函数
+Reactor::Reactor(int _id, const ServerConfig& _config, ThreadPool<HTTPConn>* _pool, int _cpu, int _node) :
+    id(_id), cpu(_cpu), node(_node), config(_config), listenFd(-1), epollFd(-1), events(nullptr),
+    pool(_pool), acceptPaused(false), acceptArmed(false), timerArmed(false),
+    ring(nullptr), wakeFd(-1), wakeCounter(0), mailboxLocker("reactor mailbox"),
+    recycledMark(0)
+{
+    slab.setNode(node);
+    pauseTimeout.tv_sec = 0;
+    pauseTimeout.tv_nsec = PAUSE_POLL_MS * 1000000L;
+
+    // 创建用于监听的socket，非阻塞以便循环accept直到EAGAIN
+    listenFd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw std::exception();
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+
+    // 端口复用
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // 多反应堆模式下每个反应堆绑定同一端口，由内核在各监听socket之间均衡新连接
+    if (config.reactorNums > 1 && setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) != 0) {
+        close(listenFd);
+        throw std::exception();
+    }
+
+    if (bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(listenFd);
+        throw std::exception();
+    }
+
+    // 监听，队列长度可配置，连接风暴时避免SYN被丢弃
+    if (listen(listenFd, config.backlog) != 0) {
+        close(listenFd);
+        throw std::exception();
+    }
+
+    if (config.ioBackend == IO_URING) {
+        // 创建io_uring、提供缓冲区环和唤醒用的eventfd
+        try {
+            ring = new IoUring(RING_ENTRIES);
+            ring->setupBufRing(0, RING_BUF_COUNT, RING_BUF_SIZE, node);
+        } catch( ... ) {
+            delete ring;
+            close(listenFd);
+            throw;
+        }
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            delete ring;
+            close(listenFd);
+            throw std::exception();
+        }
+        printf("reactor %d: io_uring backend, %s\n", id,
+               ring->usingBufRing() ? "provided buffer ring" : "IORING_OP_PROVIDE_BUFFERS");
+        ringConns.resize(1024);
+        return;
+    }
+
+    // 创建epoll对象和事件数组
+    epollFd = epoll_create(5);
+    if (epollFd < 0) {
+        close(listenFd);
+        throw std::exception();
+    }
+    events = new epoll_event[MAX_EVENT_NUMBER];
+
+    // 添加到epoll对象中
+    addfd(epollFd, listenFd, false);
+}
+
+// 析构函数
+Reactor::~Reactor() {
+    if (ring) {
+        delete ring;
+        close(wakeFd);
+    } else {
+        close(epollFd);
+    }
+    close(listenFd);
+    delete [] events;
+}
+
+// 在新线程中运行事件循环
+void Reactor::start() {
+    if (pthread_create(&thread, nullptr, worker, this) != 0) {
+        throw std::exception();
+    }
+}
+
+// 等待事件循环线程结束
+void Reactor::join() {
+    pthread_join(thread, nullptr);
+}
+
+// 回调函数，执行反应堆的事件循环
+void* Reactor::worker(void* arg) {
+    Reactor* reactor = (Reactor*)arg;
+    reactor->loop();
+    return reactor;
+}
+
+// 批量接受新连接
+// 监听socket是水平触发的，用完预算后剩余的连接会在下一轮epoll_wait中再次通知
+void Reactor::handleAccept() {
+    unsigned long batch = 0;
+    while (batch < (unsigned long)config.acceptBudget) {
+        struct sockaddr_in client_address;
+        socklen_t client_addrlength = sizeof(client_address);
+
+        // accept4直接得到非阻塞的连接socket，省去每个连接一对fcntl调用
+        int connfd = accept4(listenFd, (struct sockaddr*)&client_address, &client_addrlength,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                printf("errno is: %d\n", errno);
+            }
+            break;
+        }
+        batch++;
+
+        if (HTTPConn::userCount >= config.maxConns) {
+            close(connfd);
+            acceptStats.rejected.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        slab.acquire(connfd)->init(connfd, client_address, &slab, epollFd);
+    }
+
+    // 更新统计信息
+    acceptStats.wakeups.fetch_add(1, std::memory_order_relaxed);
+    acceptStats.accepted.fetch_add(batch, std::memory_order_relaxed);
+    if (batch > acceptStats.maxBatch.load(std::memory_order_relaxed)) {
+        acceptStats.maxBatch.store(batch, std::memory_order_relaxed);
+    }
+    if (batch == (unsigned long)config.acceptBudget) {
+        acceptStats.budgetHits.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// 把连接交给线程池
+bool Reactor::dispatch(HTTPConn* conn, int fd) {
+    if (pool->appendRequest(conn, fd)) {
+        return true;
+    }
+
+    // 队列已满，不经过工作线程直接拒绝，并停止接受新连接直到队列回落
+    conn->sendUnavailable();
+    acceptStats.overloaded.fetch_add(1, std::memory_order_relaxed);
+    pauseAccept();
+    return false;
+}
+
+// 根据线程池的排队情况暂停或恢复接受新连接
+void Reactor::checkBackpressure() {
+    size_t depth = pool->pending() * 100;
+    size_t capacity = (size_t)pool->maxRequests();
+    if (!acceptPaused && depth >= capacity * PAUSE_HIGH_PERCENT) {
+        pauseAccept();
+    } else if (acceptPaused && depth <= capacity * PAUSE_LOW_PERCENT) {
+        resumeAccept();
+    }
+}
+
+// 暂停接受新连接
+void Reactor::pauseAccept() {
+    if (acceptPaused) {
+        return;
+    }
+    acceptPaused = true;
+    acceptStats.pauses.fetch_add(1, std::memory_order_relaxed);
+
+    if (!ring) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, 0);
+        return;
+    }
+
+    ringCancelAccept();
+    if (!timerArmed) {
+        ringArmTimer();
+    }
+}
+
+// 恢复接受新连接
+void Reactor::resumeAccept() {
+    acceptPaused = false;
+    if (!ring) {
+        addfd(epollFd, listenFd, false);
+    } else if (!acceptArmed) {
+        ringArmAccept();
+    }
+}
+
+// 打印该反应堆的统计信息
+void Reactor::printStats() {
+    unsigned long wakeups = acceptStats.wakeups.load(std::memory_order_relaxed);
+    unsigned long accepted = acceptStats.accepted.load(std::memory_order_relaxed);
+    printf("reactor %d: wakeups %lu, accepted %lu, avg %.2f/wakeup, max %lu/wakeup, budget hits %lu, rejected %lu\n",
+           id, wakeups, accepted, wakeups ? (double)accepted / wakeups : 0.0,
+           acceptStats.maxBatch.load(std::memory_order_relaxed),
+           acceptStats.budgetHits.load(std::memory_order_relaxed),
+           acceptStats.rejected.load(std::memory_order_relaxed));
+    printf("    listener paused %lu times%s, %lu requests answered 503 with a full queue\n",
+           acceptStats.pauses.load(std::memory_order_relaxed), acceptPaused ? " (paused now)" : "",
+           acceptStats.overloaded.load(std::memory_order_relaxed));
+    slab.printStats();
+}
+
+// 事件循环
+void Reactor::loop() {
+    // 绑定CPU，此后该线程分配的缓冲区都在本节点上
+    if (cpu >= 0 && !pinCurrentThread(cpu)) {
+        printf("reactor %d: failed to pin to cpu %d\n", id, cpu);
+    }
+
+    if (ring) {
+        loopUring();
+        return;
+    }
+
+    while (true) {
+        // 暂停接受新连接期间定时醒来检查线程池是否已回落
+        int number = epoll_wait(epollFd, events, MAX_EVENT_NUMBER, acceptPaused ? PAUSE_POLL_MS : -1);
+
+        if ((number < 0) && (errno != EINTR)) {
+            printf("reactor %d: epoll failure\n", id);
+            break;
+        }
+
+        if (statsRequested) {
+            statsRequested = 0;
+            printServerStats();
+        }
+
+        for (int i = 0; i < number; i++) {
+            int sockfd = events[i].data.fd;
+
+            if (sockfd == listenFd) {
+                handleAccept();
+                continue;
+            }
+
+            HTTPConn* conn = slab.get(sockfd);
+            if (!conn) {
+                continue;
+            }
+
+            if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                conn->closeConn();
+
+            } else if (events[i].events & EPOLLIN) {
+                if (!conn->read() || !dispatch(conn, sockfd)) {
+                    conn->closeConn();
+                }
+
+            } else if (events[i].events & EPOLLOUT) {
+                // 流水线中还有未处理的请求时继续交给线程池
+                if (!conn->write() || (conn->hasBufferedRequest() && !dispatch(conn, sockfd))) {
+                    conn->closeConn();
+                }
+            }
+        }
+
+        checkBackpressure();
+    }
+}
+
+// io_uring后端的事件循环
+// 反应堆线程独占ring，工作线程通过mailbox和eventfd把处理完的连接交还回来
+void Reactor::loopUring() {
+    ringArmAccept();
+    ringArmWake();
+
+    while (true) {
+        // 完成队列溢出时内核暂时拒绝提交，收割完成事件后再提交
+        // 有推迟的请求时不等待，避免它们正是唯一能产生完成事件的请求
+        int ret = ring->submitAndWait(ringDeferred.empty() ? 1 : 0);
+        if (ret < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            printf("reactor %d: io_uring failure\n", id);
+            break;
+        }
+
+        if (statsRequested) {
+            statsRequested = 0;
+            printServerStats();
+        }
+
+        unsigned long batch = 0;
+        bool acceptSeen = false;
+        io_uring_cqe* cqe;
+        while ((cqe = ring->peekCqe()) != nullptr) {
+            uint64_t data = cqe->user_data;
+            RING_OP op = (RING_OP)(data >> 56);
+            unsigned gen = (data >> 32) & 0xffffff;
+            int fd = (int)(uint32_t)data;
+
+            // 连接已经关闭，丢弃旧连接遗留的完成事件
+            if ((op == OP_RECV || op == OP_SEND) &&
+                ((size_t)fd >= ringConns.size() || (ringConns[fd].gen & 0xffffff) != gen)) {
+                if (cqe->flags & IORING_CQE_F_BUFFER) {
+                    ring->recycleBuf(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                }
+                ring->cqeSeen();
+                continue;
+            }
+
+            switch (op) {
+                case OP_ACCEPT:
+                    acceptSeen = true;
+                    if (ringOnAccept(cqe)) {
+                        batch++;
+                    }
+                    break;
+                case OP_RECV:
+                    ringOnRecv(fd, cqe);
+                    break;
+                case OP_SEND:
+                    ringOnSend(fd, cqe->res);
+                    break;
+                case OP_WAKE:
+                    ringOnWake();
+                    break;
+                case OP_TIMER:
+                    timerArmed = false;
+                    break;
+                default:
+                    // 取消请求的结果无需处理，归还缓冲区的请求只在失败时才有完成事件
+                    break;
+            }
+            ring->cqeSeen();
+        }
+
+        ringRetryDeferred();
+        ringRetryStarved();
+        checkBackpressure();
+        if (acceptPaused && !timerArmed) {
+            ringArmTimer();
+        }
+
+        // 一次收割中的所有accept完成事件计为一次唤醒
+        if (acceptSeen) {
+            acceptStats.wakeups.fetch_add(1, std::memory_order_relaxed);
+            acceptStats.accepted.fetch_add(batch, std::memory_order_relaxed);
+            if (batch > acceptStats.maxBatch.load(std::memory_order_relaxed)) {
+                acceptStats.maxBatch.store(batch, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+// 获取提交队列项，队列已满时推迟该请求
+io_uring_sqe* Reactor::ringSqe(RING_OP op, int fd) {
+    io_uring_sqe* sqe = ring->getSqe();
+    if (!sqe) {
+        ringDeferred.push_back(RingDeferred{op, fd, fd >= 0 ? ringConns[fd].gen : 0});
+    }
+    return sqe;
+}
+
+// 重新提交推迟的请求，此时已收割过完成事件，仍然失败的留到下一轮
+void Reactor::ringRetryDeferred() {
+    ring->retryRecycle();
+    if (ringDeferred.empty()) {
+        return;
+    }
+    std::vector<RingDeferred> deferred;
+    deferred.swap(ringDeferred);
+    for (size_t i = 0; i < deferred.size(); i++) {
+        const RingDeferred& d = deferred[i];
+        // 连接在推迟期间已经关闭
+        if (d.fd >= 0 && ringConns[d.fd].gen != d.gen) {
+            continue;
+        }
+        switch (d.op) {
+            case OP_ACCEPT:
+                // 推迟期间暂停了接受新连接，等恢复时再提交
+                if (acceptPaused) {
+                    acceptArmed = false;
+                } else {
+                    ringArmAccept();
+                }
+                break;
+            case OP_CANCEL:
+                if (acceptPaused && acceptArmed) {
+                    ringCancelAccept();
+                }
+                break;
+            case OP_RECV:
+                ringArmRecv(d.fd);
+                break;
+            case OP_SEND:
+                ringSend(d.fd);
+                break;
+            case OP_WAKE:
+                ringArmWake();
+                break;
+            case OP_TIMER:
+                ringArmTimer();
+                break;
+        }
+    }
+}
+
+// 有缓冲区归还后重新提交等待缓冲区的recv，一轮收割中没有归还任何缓冲区时继续等待
+void Reactor::ringRetryStarved() {
+    if (ringStarved.empty() || ring->recycledBufs() == recycledMark) {
+        recycledMark = ring->recycledBufs();
+        return;
+    }
+    recycledMark = ring->recycledBufs();
+    std::vector<RingDeferred> starved;
+    starved.swap(ringStarved);
+    for (size_t i = 0; i < starved.size(); i++) {
+        // 连接在等待期间已经关闭
+        if (ringConns[starved[i].fd].gen != starved[i].gen) {
+            continue;
+        }
+        ringArmRecv(starved[i].fd);
+    }
+}
+
+// 取消多发accept，其完成事件到达时不再重新提交
+void Reactor::ringCancelAccept() {
+    io_uring_sqe* sqe = ringSqe(OP_CANCEL, -1);
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = ringData(OP_ACCEPT, -1);
+    sqe->user_data = ringData(OP_CANCEL, -1);
+}
+
+// 提交多发accept请求，每个新连接产生一个完成事件
+void Reactor::ringArmAccept() {
+    acceptArmed = true;
+    io_uring_sqe* sqe = ringSqe(OP_ACCEPT, -1);
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = ringData(OP_ACCEPT, -1);
+}
+
+// 提交读唤醒eventfd的请求
+void Reactor::ringArmWake() {
+    io_uring_sqe* sqe = ringSqe(OP_WAKE, -1);
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd;
+    sqe->addr = (unsigned long)&wakeCounter;
+    sqe->len = sizeof(wakeCounter);
+    sqe->user_data = ringData(OP_WAKE, -1);
+}
+
+// 提交定时器，到期时产生一个完成事件
+void Reactor::ringArmTimer() {
+    timerArmed = true;
+    io_uring_sqe* sqe = ringSqe(OP_TIMER, -1);
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (unsigned long)&pauseTimeout;
+    sqe->len = 1;
+    sqe->user_data = ringData(OP_TIMER, -1);
+}
+
+// 提交多发recv请求，数据由内核从提供缓冲区环中选取缓冲区存放
+void Reactor::ringArmRecv(int fd) {
+    ringConns[fd].recvArmed = true;
+    io_uring_sqe* sqe = ringSqe(OP_RECV, fd);
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = ringData(OP_RECV, fd);
+}
+
+// 处理多发accept的完成事件
+bool Reactor::ringOnAccept(io_uring_cqe* cqe) {
+    // 多发accept出错终止后需要重新提交，暂停期间被取消的等恢复时再提交
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        acceptArmed = false;
+        if (!acceptPaused) {
+            ringArmAccept();
+        }
+    }
+
+    int connfd = cqe->res;
+    if (connfd < 0) {
+        return false;
+    }
+
+    if (HTTPConn::userCount >= config.maxConns) {
+        close(connfd);
+        acceptStats.rejected.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    if ((size_t)connfd >= ringConns.size()) {
+        ringConns.resize(connfd * 2);
+    }
+    RingConn& rc = ringConns[connfd];
+    rc.state = RING_READING;
+    rc.recvArmed = false;
+    rc.peerClosed = false;
+    rc.overflow = false;
+
+    // 多发accept不返回对端地址，HTTPConn目前也不使用它
+    struct sockaddr_in client_address;
+    memset(&client_address, 0, sizeof(client_address));
+    slab.acquire(connfd)->init(connfd, client_address, &slab, -1, this);
+    ringArmRecv(connfd);
+    return true;
+}
+
+// 处理多发recv的完成事件
+void Reactor::ringOnRecv(int fd, io_uring_cqe* cqe) {
+    RingConn& rc = ringConns[fd];
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        rc.recvArmed = false;
+    }
+
+    if (cqe->res > 0) {
+        unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (rc.state == RING_READING) {
+            bool ok = slab.get(fd)->receive(ring->bufAddr(bid), cqe->res);
+            ring->recycleBuf(bid);
+            if (!ok) {
+                ringClose(fd);
+                return;
+            }
+            if (!ringDispatch(fd)) {
+                return;
+            }
+        } else if (rc.overflow) {
+            ring->recycleBuf(bid);
+            return;
+        } else {
+            // 连接正在被处理，数据先留在提供缓冲区中
+            rc.pending.push_back(std::make_pair(bid, cqe->res));
+            rc.pendingBytes += cqe->res;
+
+            // 读缓冲区放不下这些数据，连接空闲后也只能关闭，立即归还缓冲区并不再提交recv，以免一个连接占住所有连接共享的提供缓冲区
+            if (rc.pendingBytes > HTTPConn::READ_BUFFER_SIZE) {
+                rc.overflow = true;
+                for (size_t i = 0; i < rc.pending.size(); i++) {
+                    ring->recycleBuf(rc.pending[i].first);
+                }
+                rc.pending.clear();
+                rc.pendingBytes = 0;
+                return;
+            }
+        }
+        if (!rc.recvArmed) {
+            ringArmRecv(fd);
+        }
+    } else if (cqe->res == -ENOBUFS) {
+        // 提供缓冲区暂时用完，立即重新提交会在socket已有数据时马上再次失败，空转到有缓冲区归还为止
+        // 先记下该连接，视为recv仍在进行，等有缓冲区归还后再提交
+        rc.recvArmed = true;
+        ringStarved.push_back(RingDeferred{OP_RECV, fd, rc.gen});
+    } else if (rc.state == RING_READING) {
+        // 对方关闭连接或出错
+        ringClose(fd);
+    } else {
+        rc.peerClosed = true;
+    }
+}
+
+// 处理sendmsg的完成事件
+void Reactor::ringOnSend(int fd, int res) {
+    if (res < 0) {
+        ringClose(fd);
+        return;
+    }
+
+    // 发送了一部分，从停下的位置继续
+    HTTPConn* conn = slab.get(fd);
+    conn->consumeOutput(res);
+    if (!conn->outputDone()) {
+        ringSend(fd);
+        return;
+    }
+
+    if (conn->finishWrite()) {
+        ringResumeRead(fd);
+    } else {
+        ringClose(fd);
+    }
+}
+
+// 处理工作线程交还的连接
+void Reactor::ringOnWake() {
+    std::vector<std::pair<HTTPConn*, int>> posted;
+    mailboxLocker.lock();
+    posted.swap(mailbox);
+    mailboxLocker.unlock();
+    ringArmWake();
+
+    for (size_t i = 0; i < posted.size(); i++) {
+        int fd = posted[i].first->getFd();
+        if (fd < 0) {
+            continue;
+        }
+
+        switch (posted[i].second) {
+            case EPOLLIN:
+                ringResumeRead(fd);
+                break;
+            case EPOLLOUT:
+                // 响应已生成，开始发送
+                ringConns[fd].state = RING_WRITING;
+                ringSend(fd);
+                break;
+            default:
+                ringClose(fd);
+                break;
+        }
+    }
+}
+
+// 把连接交还给反应堆线程
+void Reactor::post(HTTPConn* conn, int ev) {
+    mailboxLocker.lock();
+    bool wasEmpty = mailbox.empty();
+    mailbox.push_back(std::make_pair(conn, ev));
+    mailboxLocker.unlock();
+
+    // mailbox由空变为非空时才需要唤醒反应堆
+    if (wasEmpty) {
+        uint64_t one = 1;
+        ::write(wakeFd, &one, sizeof(one));
+    }
+}
+
+// 把连接交给线程池解析请求
+bool Reactor::ringDispatch(int fd) {
+    ringConns[fd].state = RING_BUSY;
+    if (!dispatch(slab.get(fd), fd)) {
+        ringClose(fd);
+        return false;
+    }
+    return true;
+}
+
+// 连接回到读状态
+void Reactor::ringResumeRead(int fd) {
+    RingConn& rc = ringConns[fd];
+    rc.state = RING_READING;
+    if (rc.overflow) {
+        ringClose(fd);
+        return;
+    }
+
+    // 消费连接忙时收到的数据，例如流水线中后到达的请求
+    bool got = !rc.pending.empty();
+    bool ok = true;
+    for (size_t i = 0; i < rc.pending.size(); i++) {
+        unsigned short bid = rc.pending[i].first;
+        if (ok) {
+            ok = slab.get(fd)->receive(ring->bufAddr(bid), rc.pending[i].second);
+        }
+        ring->recycleBuf(bid);
+    }
+    rc.pending.clear();
+    rc.pendingBytes = 0;
+    if (!ok) {
+        ringClose(fd);
+        return;
+    }
+
+    if (got || slab.get(fd)->hasBufferedRequest()) {
+        ringDispatch(fd);
+    } else if (rc.peerClosed) {
+        ringClose(fd);
+    } else if (!rc.recvArmed) {
+        ringArmRecv(fd);
+    }
+}
+
+// 从已发送的位置继续发送响应，排队的所有响应在一次sendmsg中发出，超过IOV_MAX段时分多次
+void Reactor::ringSend(int fd) {
+    // 文件内容还不在页缓存中时先由I/O线程池预读，完成后重新投递EPOLLOUT，sendmsg不在反应堆线程上缺页
+    HTTPConn* conn = slab.get(fd);
+    if (!conn->fileReady()) {
+        return;
+    }
+
+    // io_uring后端的文件都已映射，发送队列中只有内存段，队首是文件段时sendmsg发出0字节，会无限重发
+    int count = 0;
+    const struct iovec* iov = conn->responseIov(count);
+    assert(count > 0);
+    if (count == 0) {
+        printf("reactor %d: file segment queued on io_uring backend\n", id);
+        ringClose(fd);
+        return;
+    }
+
+    io_uring_sqe* sqe = ringSqe(OP_SEND, fd);
+    if (!sqe) {
+        return;
+    }
+
+    RingConn& rc = ringConns[fd];
+
+    // 发送队列在完成事件到达前不会改变，直接引用其中的内存段
+    memset(&rc.msg, 0, sizeof(rc.msg));
+    rc.msg.msg_iov = (struct iovec*)iov;
+    rc.msg.msg_iovlen = count;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)&rc.msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = ringData(OP_SEND, fd);
+}
+
+// 关闭连接
+void Reactor::ringClose(int fd) {
+    RingConn& rc = ringConns[fd];
+    for (size_t i = 0; i < rc.pending.size(); i++) {
+        ring->recycleBuf(rc.pending[i].first);
+    }
+    rc.pending.clear();
+    rc.pendingBytes = 0;
+    rc.state = RING_CLOSED;
+    rc.gen++;
+    HTTPConn* conn = slab.get(fd);
+    if (conn) {
+        conn->closeConn();
+    }
+}
@@ -0,0 +1,263 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "locker.h"
+#include "threadpool.h"
+#include "httpConn.h"
+#include "config.h"
+#include "ioUring.h"
+#include "connSlab.h"
+
+// 接受连接的统计信息，由反应堆线程更新，其他线程只读
+struct AcceptStats {
+    // 监听socket可读而被唤醒的次数
+    std::atomic<unsigned long> wakeups{0};
+
+    // 接受的连接总数
+    std::atomic<unsigned long> accepted{0};
+
+    // 单次唤醒接受的最大连接数
+    std::atomic<unsigned long> maxBatch{0};
+
+    // 单次唤醒用完接受预算、队列中可能还有连接的次数
+    std::atomic<unsigned long> budgetHits{0};
+
+    // 因连接数超过上限而直接关闭的连接数
+    std::atomic<unsigned long> rejected{0};
+
+    // 线程池饱和而暂停接受新连接的次数
+    std::atomic<unsigned long> pauses{0};
+
+    // 线程池队列已满而直接回复503的请求数
+    std::atomic<unsigned long> overloaded{0};
+};
+
+// 反应堆类，每个反应堆拥有独立的epoll实例、监听socket和自己接受的连接
+class Reactor {
+public:
+    // 监听的最大的事件数量
+    static const int MAX_EVENT_NUMBER = 10000;
+
+    // io_uring提交队列的大小
+    static const int RING_ENTRIES = 4096;
+
+    // io_uring提供缓冲区的个数和大小
+    static const int RING_BUF_COUNT = 2048;
+    static const int RING_BUF_SIZE = HTTPConn::READ_BUFFER_SIZE;
+
+    // 线程池中排队的请求数达到容量的该百分比时暂停接受新连接，回落到低水位后恢复
+    static const int PAUSE_HIGH_PERCENT = 90;
+    static const int PAUSE_LOW_PERCENT = 50;
+
+    // 暂停期间检查线程池队列的间隔，单位为毫秒
+    static const int PAUSE_POLL_MS = 10;
+
+    // 构造函数，创建监听socket和epoll对象（或io_uring），失败则抛出异常
+    // 多于一个反应堆时使用SO_REUSEPORT，各反应堆各自监听同一端口，由内核分发新连接
+    // cpu不为-1时事件循环绑定到该CPU，连接对象和缓冲区优先分配在其NUMA节点node上
+    Reactor(int _id, const ServerConfig& _config, ThreadPool<HTTPConn>* _pool, int _cpu = -1, int _node = -1);
+
+    // 析构函数，关闭epoll对象和监听socket
+    ~Reactor();
+
+    // 在新线程中运行事件循环
+    void start();
+
+    // 等待事件循环线程结束
+    void join();
+
+    // 在当前线程中运行事件循环
+    void loop();
+
+    // 打印该反应堆的统计信息
+    void printStats();
+
+    // io_uring后端下由工作线程调用，把连接交还给反应堆线程，ev的含义同HTTPConn::rearm
+    void post(HTTPConn* conn, int ev);
+
+private:
+    // io_uring后端中连接的状态
+    enum RING_STATE {
+        RING_CLOSED = 0,    // 未使用
+        RING_READING,       // 等待请求数据
+        RING_BUSY,          // 请求在线程池中处理
+        RING_WRITING        // 正在发送响应
+    };
+
+    // io_uring请求的类型，编码在user_data的高位
+    enum RING_OP { OP_ACCEPT = 1, OP_RECV, OP_SEND, OP_WAKE, OP_CANCEL, OP_TIMER };
+
+    // io_uring后端中每个连接的状态，以fd为下标
+    struct RingConn {
+        // 连接的代数，关闭连接时加一，旧连接遗留的完成事件据此丢弃
+        unsigned gen = 0;
+        RING_STATE state = RING_CLOSED;
+
+        // 多发recv是否仍在内核中，或因提交队列已满等待重新提交
+        bool recvArmed = false;
+
+        // 对方在连接忙时关闭了连接
+        bool peerClosed = false;
+
+        // 连接忙时收到的数据，保存所在的提供缓冲区编号和长度，空闲后再交给连接
+        std::vector<std::pair<unsigned short, int>> pending;
+        int pendingBytes = 0;
+
+        // 连接忙时收到的数据超过了读缓冲区的大小，已无法交给连接，之后收到的数据直接丢弃，空闲后关闭连接
+        bool overflow = false;
+
+        // 正在进行的sendmsg，完成前必须保持有效，内存段指向连接的发送队列
+        struct msghdr msg;
+    };
+
+    // 提交队列已满时推迟的请求，gen用于丢弃已关闭连接的请求
+    struct RingDeferred {
+        RING_OP op;
+        int fd;
+        unsigned gen;
+    };
+
+    // 创建线程用的回调函数
+    static void* worker(void* arg);
+
+    // 批量接受新连接，直到队列为空或用完本次的接受预算
+    void handleAccept();
+
+    // 把连接交给线程池，队列已满时直接回复503并关闭连接，返回是否交出
+    bool dispatch(HTTPConn* conn, int fd);
+
+    // 根据线程池的排队情况暂停或恢复接受新连接
+    void checkBackpressure();
+
+    // 暂停和恢复接受新连接，暂停期间新连接留在内核的监听队列中
+    void pauseAccept();
+    void resumeAccept();
+
+    // io_uring后端的事件循环
+    void loopUring();
+
+    // 获取提交队列项，队列已满时返回nullptr，并记下该请求，收割完成事件后由ringRetryDeferred重新提交
+    io_uring_sqe* ringSqe(RING_OP op, int fd);
+
+    // 重新提交推迟的请求
+    void ringRetryDeferred();
+
+    // 有缓冲区归还后，为因缓冲区用完而停止接收的连接重新提交recv
+    void ringRetryStarved();
+
+    // 取消多发accept
+    void ringCancelAccept();
+
+    // 提交多发accept请求
+    void ringArmAccept();
+
+    // 提交读唤醒eventfd的请求
+    void ringArmWake();
+
+    // 暂停接受新连接期间提交定时器，到期后检查线程池的排队情况
+    void ringArmTimer();
+
+    // 提交多发recv请求
+    void ringArmRecv(int fd);
+
+    // 处理多发accept的完成事件，返回是否接受了新连接
+    bool ringOnAccept(io_uring_cqe* cqe);
+
+    // 处理多发recv的完成事件
+    void ringOnRecv(int fd, io_uring_cqe* cqe);
+
+    // 处理sendmsg的完成事件
+    void ringOnSend(int fd, int res);
+
+    // 处理工作线程交还的连接
+    void ringOnWake();
+
+    // 把连接交给线程池解析请求，返回false表示连接已因过载被关闭
+    bool ringDispatch(int fd);
+
+    // 连接回到读状态，先消费连接忙时收到的数据
+    void ringResumeRead(int fd);
+
+    // 从已发送的位置继续发送响应
+    void ringSend(int fd);
+
+    // 关闭连接，归还其占用的提供缓冲区
+    void ringClose(int fd);
+
+    // 编码和解码io_uring请求的user_data
+    uint64_t ringData(RING_OP op, int fd) {
+        unsigned gen = fd >= 0 ? ringConns[fd].gen : 0;
+        return ((uint64_t)op << 56) | ((uint64_t)(gen & 0xffffff) << 32) | (uint32_t)fd;
+    }
+
+private:
+    // 反应堆编号
+    int id;
+
+    // 事件循环绑定的CPU及其NUMA节点，-1表示不绑定
+    int cpu;
+    int node;
+
+    // 服务器的运行参数
+    const ServerConfig& config;
+
+    // 监听socket
+    int listenFd;
+
+    // 该反应堆的epoll对象
+    int epollFd;
+
+    // 就绪事件数组
+    epoll_event* events;
+
+    // 该反应堆接受的连接，按需分配
+    ConnSlab slab;
+
+    // 处理请求的线程池
+    ThreadPool<HTTPConn>* pool;
+
+    // 事件循环所在的线程
+    pthread_t thread;
+
+    // 接受连接的统计信息
+    AcceptStats acceptStats;
+
+    // 是否因线程池饱和暂停了接受新连接
+    bool acceptPaused;
+
+    // io_uring后端中多发accept请求和暂停期间的定时器是否在内核中，或等待重新提交
+    bool acceptArmed;
+    bool timerArmed;
+    struct __kernel_timespec pauseTimeout;
+
+    // io_uring后端使用的ring
+    IoUring* ring;
+
+    // 工作线程交还连接时用于唤醒反应堆的eventfd
+    int wakeFd;
+    uint64_t wakeCounter;
+
+    // 工作线程交还的连接及其后续动作
+    Locker mailboxLocker;
+    std::vector<std::pair<HTTPConn*, int>> mailbox;
+
+    // io_uring后端中各连接的状态，尚未提交的sendmsg指向其中的msg，扩容时元素的地址不能改变
+    std::deque<RingConn> ringConns;
+
+    // io_uring后端中因提交队列已满推迟的请求
+    std::vector<RingDeferred> ringDeferred;
+
+    // 因提供缓冲区用完而终止了recv的连接，等有缓冲区归还后再提交，recycledMark为上次检查时的归还计数
+    std::vector<RingDeferred> ringStarved;
+    unsigned long recycledMark;
+};
+
+#endif
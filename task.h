@@ -0,0 +1,239 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "futex.h"
+
+// 只能移动的可调用对象，捕获较小的可调用对象直接存放在对象内部，不分配堆内存
+// 超过INLINE_SIZE、对齐要求过高或移动可能抛出异常的可调用对象才在堆上分配
+class Task {
+public:
+    // 内部存储的大小，足够放下捕获几个指针和整数的lambda
+    static const size_t INLINE_SIZE = 48;
+
+    Task() noexcept : ops(nullptr) {}
+
+    // 由任意可调用对象构造
+    template <typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f);
+
+    Task(Task&& other) noexcept : ops(nullptr) {
+        moveFrom(other);
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        reset();
+    }
+
+    // 执行任务
+    void operator()() {
+        ops->invoke(storage);
+    }
+
+    // 是否持有可调用对象
+    explicit operator bool() const {
+        return ops != nullptr;
+    }
+
+    // 可调用对象是否存放在对象内部
+    bool isInline() const {
+        return ops && ops->isInline;
+    }
+
+private:
+    // 按可调用对象的类型生成的操作表
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* storage);
+        bool isInline;
+    };
+
+    // 存放在内部时的操作
+    template <typename F>
+    struct InlineOps {
+        static void invoke(void* s) { (*(F*)s)(); }
+        static void move(void* dst, void* src) { new (dst) F(std::move(*(F*)src)); ((F*)src)->~F(); }
+        static void destroy(void* s) { ((F*)s)->~F(); }
+        static const Ops ops;
+    };
+
+    // 存放在堆上时的操作，内部只保存指针
+    template <typename F>
+    struct HeapOps {
+        static void invoke(void* s) { (**(F**)s)(); }
+        static void move(void* dst, void* src) { *(F**)dst = *(F**)src; }
+        static void destroy(void* s) { delete *(F**)s; }
+        static const Ops ops;
+    };
+
+    // 可调用对象能否存放在内部
+    template <typename Fn>
+    struct FitsInline : std::integral_constant<bool,
+        sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible<Fn>::value> {};
+
+    // 存放在内部
+    template <typename Fn, typename F>
+    void construct(F&& f, std::true_type) {
+        new (storage) Fn(std::forward<F>(f));
+        ops = &InlineOps<Fn>::ops;
+    }
+
+    // 存放在堆上
+    template <typename Fn, typename F>
+    void construct(F&& f, std::false_type) {
+        *(Fn**)storage = new Fn(std::forward<F>(f));
+        ops = &HeapOps<Fn>::ops;
+    }
+
+    void moveFrom(Task& other) noexcept {
+        if (other.ops) {
+            other.ops->move(storage, other.storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+    }
+
+    void reset() noexcept {
+        if (ops) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char storage[INLINE_SIZE];
+    const Ops* ops;
+};
+
+template <typename F>
+const Task::Ops Task::InlineOps<F>::ops = {&InlineOps<F>::invoke, &InlineOps<F>::move, &InlineOps<F>::destroy, true};
+
+template <typename F>
+const Task::Ops Task::HeapOps<F>::ops = {&HeapOps<F>::invoke, &HeapOps<F>::move, &HeapOps<F>::destroy, false};
+
+// 由任意可调用对象构造
+template <typename F, typename>
+Task::Task(F&& f) : ops(nullptr) {
+    typedef typename std::decay<F>::type Fn;
+    construct<Fn>(std::forward<F>(f), FitsInline<Fn>());
+}
+
+// 任务的完成状态，由任务和完成句柄共享
+template <typename R>
+struct TaskState {
+    // 0表示未完成，1表示已完成，用作futex
+    std::atomic<uint32_t> done{0};
+    std::exception_ptr error;
+    typename std::aligned_storage<sizeof(R), alignof(R)>::type value;
+
+    ~TaskState() {
+        if (done.load() && !error) {
+            ((R*)&value)->~R();
+        }
+    }
+
+    // 执行f并保存结果
+    template <typename F>
+    void run(F& f) {
+        try {
+            new (&value) R(f());
+        } catch (...) {
+            error = std::current_exception();
+        }
+        finish();
+    }
+
+    R take() {
+        return std::move(*(R*)&value);
+    }
+
+    void finish() {
+        done.store(1, std::memory_order_release);
+        futexWake(&done, 0x7fffffff);
+    }
+};
+
+template <>
+struct TaskState<void> {
+    std::atomic<uint32_t> done{0};
+    std::exception_ptr error;
+
+    template <typename F>
+    void run(F& f) {
+        try {
+            f();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        finish();
+    }
+
+    void take() {}
+
+    void finish() {
+        done.store(1, std::memory_order_release);
+        futexWake(&done, 0x7fffffff);
+    }
+};
+
+// 任务的完成句柄，可以查询、等待任务完成并取得其结果
+// 提交失败时得到的句柄无效，valid()返回false
+template <typename R>
+class TaskFuture {
+public:
+    TaskFuture() {}
+    explicit TaskFuture(std::shared_ptr<TaskState<R>> _state) : state(std::move(_state)) {}
+
+    // 是否关联了一个任务
+    bool valid() const {
+        return state != nullptr;
+    }
+
+    // 任务是否已完成
+    bool ready() const {
+        return state->done.load(std::memory_order_acquire) != 0;
+    }
+
+    // 等待任务完成
+    void wait() const {
+        while (!ready()) {
+            futexWait(&state->done, 0);
+        }
+    }
+
+    // 等待任务完成并取得结果，任务抛出的异常在这里重新抛出，只能调用一次
+    R get() {
+        wait();
+        std::shared_ptr<TaskState<R>> s = std::move(state);
+        if (s->error) {
+            std::rethrow_exception(s->error);
+        }
+        return s->take();
+    }
+
+private:
+    std::shared_ptr<TaskState<R>> state;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#!/bin/sh
+# 文件发送方式的对比测试：mmap+writev、sendfile、splice
+# 对每种方式和每种文件大小，用webbench测量每分钟完成的请求数，再用多个curl并发下载大文件，校验内容并报告吞吐量
+# 用法: test/bench/fileSend.sh [服务器程序] [webbench客户端数] [每项的秒数] [大文件MB]
+# 需要先编译好服务器和test/webbench，以及curl和sha256sum
+
+SERVER=${1:-./tinywebserver.out}
+CLIENTS=${2:-50}
+SECONDS_EACH=${3:-5}
+LARGE_MB=${4:-256}
+PORT=${PORT:-9291}
+MODES=${MODES:-"mmap sendfile:0 splice:0"}
+SIZES_KB=${SIZES_KB:-"4 64 1024"}
+WEBBENCH=${WEBBENCH:-test/webbench/webbench}
+
+ROOT=$(mktemp -d)
+trap 'rm -rf "$ROOT"' EXIT
+
+for kb in $SIZES_KB; do
+    head -c $((kb * 1024)) /dev/urandom > "$ROOT/$kb.bin"
+done
+head -c $((LARGE_MB * 1024 * 1024)) /dev/urandom > "$ROOT/large.bin"
+EXPECTED=$(sha256sum < "$ROOT/large.bin" | cut -d' ' -f1)
+failed=0
+
+for mode in $MODES; do
+    "$SERVER" -s "$mode" -d "$ROOT" "$PORT" > /dev/null 2>&1 &
+    server=$!
+    sleep 0.5
+
+    echo "== $mode"
+    for kb in $SIZES_KB; do
+        # webbench的子进程会重复输出开头的信息，只取最后的结果
+        "$WEBBENCH" -2 -c "$CLIENTS" -t "$SECONDS_EACH" "http://127.0.0.1:$PORT/$kb.bin" 2>&1 |
+            awk -v kb="$kb" '/^Speed=/ { split($1, a, "="); pages = a[2] } /failed/ { f = $4 }
+                END { printf "%6d KB: %9d req/min, %8.1f MB/s, %s failed\n", kb, pages, pages * kb / 1024 / 60, f }'
+    done
+
+    start=$(date +%s.%N)
+    curl -s -o "$ROOT/out.0" "http://127.0.0.1:$PORT/large.bin" &
+    c0=$!
+    curl -s -o "$ROOT/out.1" "http://127.0.0.1:$PORT/large.bin" &
+    c1=$!
+    wait $c0 $c1
+    end=$(date +%s.%N)
+    ok=0
+    for i in 0 1; do
+        [ "$(sha256sum < "$ROOT/out.$i" | cut -d' ' -f1)" = "$EXPECTED" ] && ok=$((ok + 1))
+        rm -f "$ROOT/out.$i"
+    done
+    [ $ok -eq 2 ] || failed=1
+    awk -v s="$start" -v e="$end" -v mb="$LARGE_MB" -v ok="$ok" 'BEGIN {
+        printf "2 x %d MB: %d/2 byte-exact, %.1f MB/s total\n", mb, ok, mb * 2 / (e - s)
+    }'
+
+    kill "$server"
+    wait "$server" 2>/dev/null
+    PORT=$((PORT + 1))
+done
+
+exit $failed
@@ -0,0 +1,25 @@
+#!/bin/sh
+# epoll与io_uring后端的对比测试
+# 用法: test/bench/ioBackend.sh [服务器程序] [URL路径] [并发数] [秒数]
+# 需要先编译好服务器和test/webbench，并把资源目录放在服务器的网站根目录下
+
+SERVER=${1:-./tinywebserver.out}
+URL_PATH=${2:-/index.html}
+CLIENTS=${3:-200}
+SECONDS_=${4:-10}
+PORT=${PORT:-9190}
+REACTORS=${REACTORS:-1}
+WEBBENCH=$(dirname "$0")/../webbench/webbench
+
+for backend in epoll uring; do
+    "$SERVER" -r "$REACTORS" -i "$backend" "$PORT" > /dev/null 2>&1 &
+    pid=$!
+    sleep 0.5
+
+    echo "== $backend: $CLIENTS clients, $SECONDS_ s, $URL_PATH"
+    "$WEBBENCH" -2 -c "$CLIENTS" -t "$SECONDS_" "http://127.0.0.1:$PORT$URL_PATH" 2>&1 | tail -2
+
+    kill "$pid"
+    wait "$pid" 2>/dev/null
+    PORT=$((PORT + 1))
+done
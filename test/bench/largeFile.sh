@@ -0,0 +1,62 @@
+#!/bin/sh
+# 大文件的部分写入与续传测试
+# 生成一个随机内容的大文件，由多个限速的客户端同时下载，服务器的socket缓冲区反复写满，
+# 每个响应都要经过多次部分写入和续传，最后校验每个客户端收到的内容与原文件完全一致并报告吞吐量
+# 用法: test/bench/largeFile.sh [服务器程序] [文件大小MB] [客户端数] [每个客户端的限速，0为不限速]
+# 需要先编译好服务器，以及curl和sha256sum
+
+SERVER=${1:-./tinywebserver.out}
+SIZE_MB=${2:-256}
+CLIENTS=${3:-4}
+RATE=${4:-100M}
+PORT=${PORT:-9191}
+BACKENDS=${BACKENDS:-"epoll uring"}
+
+ROOT=$(mktemp -d)
+trap 'rm -rf "$ROOT"' EXIT
+
+head -c $((SIZE_MB * 1024 * 1024)) /dev/urandom > "$ROOT/large.bin"
+EXPECTED=$(sha256sum < "$ROOT/large.bin" | cut -d' ' -f1)
+failed=0
+
+for backend in $BACKENDS; do
+    "$SERVER" -i "$backend" -d "$ROOT" "$PORT" > /dev/null 2>&1 &
+    server=$!
+    sleep 0.5
+
+    echo "== $backend: $CLIENTS clients x $SIZE_MB MB, limit $RATE/s each"
+    start=$(date +%s.%N)
+    pids=""
+    i=0
+    while [ $i -lt "$CLIENTS" ]; do
+        curl -s --limit-rate "$RATE" -o "$ROOT/out.$i" "http://127.0.0.1:$PORT/large.bin" &
+        pids="$pids $!"
+        i=$((i + 1))
+    done
+    wait $pids
+    end=$(date +%s.%N)
+
+    ok=0
+    i=0
+    while [ $i -lt "$CLIENTS" ]; do
+        if [ "$(sha256sum < "$ROOT/out.$i" | cut -d' ' -f1)" = "$EXPECTED" ]; then
+            ok=$((ok + 1))
+        else
+            echo "client $i: $(stat -c %s "$ROOT/out.$i" 2>/dev/null || echo 0) bytes, content mismatch"
+        fi
+        rm -f "$ROOT/out.$i"
+        i=$((i + 1))
+    done
+    [ $ok -eq "$CLIENTS" ] || failed=1
+
+    awk -v s="$start" -v e="$end" -v mb="$SIZE_MB" -v n="$CLIENTS" -v ok="$ok" 'BEGIN {
+        t = e - s
+        printf "%d/%d byte-exact, %.2f s, %.1f MB/s total\n", ok, n, t, mb * n / t
+    }'
+
+    kill "$server"
+    wait "$server" 2>/dev/null
+    PORT=$((PORT + 1))
+done
+
+exit $failed
@@ -0,0 +1,269 @@
+// locker.h中基于futex的同步原语的压力测试
+// 检查互斥锁、自旋锁和读写锁的互斥性，读写锁的写者优先，以及条件变量和信号量不丢失唤醒
+// 编译: g++ -O2 -pthread -I../.. lockerStress.cpp -o lockerStress
+// 用法: ./lockerStress [线程数] [每个线程的迭代次数]
+// 全部通过时返回0，某项卡住超过TIMEOUT秒视为丢失唤醒，直接失败退出
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+#include "locker.h"
+
+static const int TIMEOUT = 30;
+
+static int threads = 8;
+static long iterations = 200000;
+static int failed = 0;
+
+// 超时说明有线程再也没有被唤醒
+static void onAlarm(int) {
+    static const char msg[] = "timed out, lost wakeup\n";
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    _exit(2);
+}
+
+// 在threads个线程中运行f(i)，并等待全部结束
+template <typename F>
+static void runThreads(int n, F f) {
+    struct Arg {
+        F* f;
+        int i;
+    };
+    std::vector<pthread_t> tids(n);
+    std::vector<Arg> args(n);
+    for (int i = 0; i < n; i++) {
+        args[i] = Arg{&f, i};
+        pthread_create(&tids[i], nullptr, [](void* p) -> void* {
+            Arg* arg = (Arg*)p;
+            (*arg->f)(arg->i);
+            return nullptr;
+        }, &args[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_join(tids[i], nullptr);
+    }
+}
+
+static void check(const char* name, bool ok) {
+    printf("%-28s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) {
+        failed = 1;
+    }
+}
+
+// 临界区内的非原子读改写，互斥失效时计数会丢失，同时检查临界区内只有一个线程
+template <typename Lock>
+static void testMutex(const char* name, Lock& lock) {
+    long counter = 0;
+    std::atomic<int> inside(0);
+    std::atomic<bool> overlap(false);
+    runThreads(threads, [&](int) {
+        for (long i = 0; i < iterations; i++) {
+            lock.lock();
+            if (inside.fetch_add(1, std::memory_order_relaxed) != 0) {
+                overlap = true;
+            }
+            counter = counter + 1;
+            inside.fetch_sub(1, std::memory_order_relaxed);
+            lock.unlock();
+        }
+    });
+    check(name, !overlap && counter == threads * iterations);
+}
+
+// 读写锁：写者之间、写者与读者之间互斥，读者可以同时持有
+static void testRWLockExclusion() {
+    RWLock lock;
+    long counter = 0;
+    std::atomic<int> readers(0);
+    std::atomic<int> writers(0);
+    std::atomic<bool> bad(false);
+    runThreads(threads, [&](int id) {
+        for (long i = 0; i < iterations; i++) {
+            // 每四次操作中一次写
+            if ((i + id) % 4 == 0) {
+                lock.writeLock();
+                if (writers.fetch_add(1) != 0 || readers.load() != 0) {
+                    bad = true;
+                }
+                counter = counter + 1;
+                writers.fetch_sub(1);
+                lock.writeUnlock();
+            } else {
+                lock.readLock();
+                readers.fetch_add(1);
+                if (writers.load() != 0) {
+                    bad = true;
+                }
+                readers.fetch_sub(1);
+                lock.readUnlock();
+            }
+        }
+    });
+    long writes = 0;
+    for (int id = 0; id < threads; id++) {
+        for (long i = 0; i < iterations; i++) {
+            writes += (i + id) % 4 == 0;
+        }
+    }
+    check("RWLock exclusion", !bad && counter == writes);
+}
+
+// 读写锁的写者优先：读者持有锁时来了写者，之后的新读者要等写者完成后才能进入
+static void testRWLockWriterPreference() {
+    RWLock lock;
+    std::atomic<bool> writerDone(false);
+    std::atomic<bool> readerSawWriter(false);
+    std::atomic<int> stage(0);
+    lock.readLock();
+    runThreads(3, [&](int id) {
+        if (id == 0) {
+            lock.writeLock();
+            writerDone = true;
+            lock.writeUnlock();
+        } else if (id == 1) {
+            // 写者已在等待时到来的读者
+            usleep(50000);
+            stage = 1;
+            lock.readLock();
+            readerSawWriter = writerDone.load();
+            lock.readUnlock();
+        } else {
+            // 新读者到来后再释放最初的读锁
+            while (stage.load() == 0) {
+                sched_yield();
+            }
+            usleep(50000);
+            lock.readUnlock();
+        }
+    });
+    check("RWLock writer preference", readerSawWriter);
+}
+
+// 读写锁的唤醒：写者与读者反复交替，休眠的一方不能错过解锁
+static void testRWLockWakeups() {
+    RWLock lock;
+    runThreads(threads, [&](int id) {
+        for (long i = 0; i < iterations / 10; i++) {
+            if (id % 2 == 0) {
+                lock.writeLock();
+                lock.writeUnlock();
+            } else {
+                lock.readLock();
+                lock.readUnlock();
+            }
+        }
+    });
+    check("RWLock wakeups", true);
+}
+
+// 条件变量：两个线程通过共享的轮次乒乓，任何一次丢失的通知都会让双方永远等待
+static void testCondPingPong() {
+    Locker locker;
+    Cond cond;
+    long turn = 0;
+    runThreads(2, [&](int id) {
+        for (long i = 0; i < iterations; i++) {
+            locker.lock();
+            while (turn % 2 != id) {
+                cond.wait(locker);
+            }
+            turn++;
+            cond.signal();
+            locker.unlock();
+        }
+    });
+    check("Cond ping-pong", turn == 2 * iterations);
+}
+
+// 条件变量：多个消费者等待，生产者逐个发布并广播
+static void testCondBroadcast() {
+    Locker locker;
+    Cond cond;
+    long available = 0;
+    long consumed = 0;
+    long total = iterations;
+    runThreads(threads, [&](int id) {
+        if (id == 0) {
+            for (long i = 0; i < total; i++) {
+                locker.lock();
+                available++;
+                cond.broadcast();
+                locker.unlock();
+            }
+            return;
+        }
+        while (true) {
+            locker.lock();
+            while (available == 0 && consumed < total) {
+                cond.wait(locker);
+            }
+            if (consumed == total) {
+                cond.broadcast();
+                locker.unlock();
+                return;
+            }
+            available--;
+            consumed++;
+            if (consumed == total) {
+                cond.broadcast();
+            }
+            locker.unlock();
+        }
+    });
+    check("Cond broadcast", consumed == total && available == 0);
+}
+
+// 信号量：生产者post，消费者wait，每次post恰好让一次wait返回
+static void testSem() {
+    Sem sem;
+    std::atomic<long> got(0);
+    int consumers = threads > 1 ? threads / 2 : 1;
+    int producers = threads > 1 ? threads - consumers : 1;
+    long perProducer = iterations;
+    long total = producers * perProducer;
+    runThreads(producers + consumers, [&](int id) {
+        if (id < producers) {
+            for (long i = 0; i < perProducer; i++) {
+                sem.post();
+            }
+            return;
+        }
+        // 每个消费者取固定的份额，最后一个取余数
+        int c = id - producers;
+        long share = total / consumers + (c == consumers - 1 ? total % consumers : 0);
+        for (long i = 0; i < share; i++) {
+            sem.wait();
+            got.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    check("Sem post/wait", got == total && !sem.tryWait());
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) threads = atoi(argv[1]);
+    if (argc > 2) iterations = atol(argv[2]);
+    if (threads < 2 || iterations < 1) {
+        printf("usage: %s [threads >= 2] [iterations]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGALRM, onAlarm);
+    alarm(TIMEOUT);
+    printf("%d threads, %ld iterations\n", threads, iterations);
+
+    Locker locker;
+    testMutex("Locker exclusion", locker);
+    SpinLock spin;
+    testMutex("SpinLock exclusion", spin);
+    testRWLockExclusion();
+    testRWLockWriterPreference();
+    testRWLockWakeups();
+    testCondPingPong();
+    testCondBroadcast();
+    testSem();
+    return failed;
+}
@@ -0,0 +1,188 @@
+// 线程池请求队列的微基准测试
+// 对比原来的 std::list + pthread互斥锁 + POSIX信号量 与 无锁环形队列 + futex事件计数器
+// 编译: g++ -O2 -pthread -I../.. queueBench.cpp -o queueBench
+// 用法: ./queueBench [生产者数] [消费者数] [每个生产者的请求数]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+#include <semaphore.h>
+#include "mpmcQueue.h"
+#include "futex.h"
+
+// 原来ThreadPool使用的队列
+// locker.h中的Locker和Sem已改为基于futex实现，这里直接使用pthread互斥锁和POSIX信号量，保持原来的开销
+struct LegacyQueue {
+    std::list<long*> reqQueue;
+    pthread_mutex_t queueLocker;
+    sem_t queueStat;
+    size_t maxReqNums;
+
+    LegacyQueue(size_t n) : maxReqNums(n) {
+        pthread_mutex_init(&queueLocker, nullptr);
+        sem_init(&queueStat, 0, 0);
+    }
+
+    ~LegacyQueue() {
+        sem_destroy(&queueStat);
+        pthread_mutex_destroy(&queueLocker);
+    }
+
+    bool push(long* req) {
+        pthread_mutex_lock(&queueLocker);
+        if (reqQueue.size() > maxReqNums) {
+            pthread_mutex_unlock(&queueLocker);
+            return false;
+        }
+        reqQueue.push_back(req);
+        pthread_mutex_unlock(&queueLocker);
+        sem_post(&queueStat);
+        return true;
+    }
+
+    long* pop() {
+        while (true) {
+            sem_wait(&queueStat);
+            pthread_mutex_lock(&queueLocker);
+            if (reqQueue.empty()) {
+                pthread_mutex_unlock(&queueLocker);
+                continue;
+            }
+            long* req = reqQueue.front();
+            reqQueue.pop_front();
+            pthread_mutex_unlock(&queueLocker);
+            return req;
+        }
+    }
+};
+
+// 现在ThreadPool使用的队列
+struct RingQueue {
+    MPMCQueue<long*> reqQueue;
+    EventCount idleWorkers;
+
+    RingQueue(size_t n) : reqQueue(n) {}
+
+    bool push(long* req) {
+        if (!reqQueue.push(req)) {
+            return false;
+        }
+        idleWorkers.notify(1);
+        return true;
+    }
+
+    long* pop() {
+        long* req = nullptr;
+        while (true) {
+            for (int i = 0; i < 64; i++) {
+                if (reqQueue.pop(req)) {
+                    return req;
+                }
+                cpuRelax();
+            }
+            uint32_t key = idleWorkers.prepareWait();
+            if (reqQueue.pop(req)) {
+                idleWorkers.cancelWait();
+                return req;
+            }
+            idleWorkers.wait(key);
+        }
+    }
+};
+
+static int producers = 1;
+static int consumers = 8;
+static long perProducer = 1000000;
+
+// 每个请求的内容，消费者对其累加以防止被优化掉
+static long payload = 1;
+
+template <typename Q>
+struct Bench {
+    Q queue;
+    std::atomic<long> sum;
+
+    Bench() : queue(10000), sum(0) {}
+
+    static void* produce(void* arg) {
+        Bench* b = (Bench*)arg;
+        for (long i = 0; i < perProducer; i++) {
+            // 队列满时重试，与反应堆在满时的行为不同，但保证所有请求都被处理
+            while (!b->queue.push(&payload)) {
+                sched_yield();
+            }
+        }
+        return nullptr;
+    }
+
+    static void* consume(void* arg) {
+        Bench* b = (Bench*)arg;
+        long local = 0;
+        while (true) {
+            long* req = b->queue.pop();
+            if (!req) {
+                break;
+            }
+            local += *req;
+        }
+        b->sum.fetch_add(local);
+        return nullptr;
+    }
+
+    double run() {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        std::vector<pthread_t> threads(producers + consumers);
+        for (int i = 0; i < consumers; i++) {
+            pthread_create(&threads[i], nullptr, consume, this);
+        }
+        for (int i = 0; i < producers; i++) {
+            pthread_create(&threads[consumers + i], nullptr, produce, this);
+        }
+        for (int i = 0; i < producers; i++) {
+            pthread_join(threads[consumers + i], nullptr);
+        }
+
+        // 每个消费者收到一个空请求后退出
+        for (int i = 0; i < consumers; i++) {
+            while (!queue.push(nullptr)) {
+                sched_yield();
+            }
+        }
+        for (int i = 0; i < consumers; i++) {
+            pthread_join(threads[i], nullptr);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (sum.load() != producers * perProducer) {
+            printf("lost requests: %ld of %ld\n", sum.load(), producers * perProducer);
+        }
+        return secs;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) producers = atoi(argv[1]);
+    if (argc > 2) consumers = atoi(argv[2]);
+    if (argc > 3) perProducer = atol(argv[3]);
+
+    long total = producers * perProducer;
+    printf("%d producers, %d consumers, %ld requests\n", producers, consumers, total);
+
+    Bench<LegacyQueue>* legacy = new Bench<LegacyQueue>;
+    double t1 = legacy->run();
+    printf("list+mutex+sem : %.3f s, %.2f M req/s\n", t1, total / t1 / 1e6);
+    delete legacy;
+
+    Bench<RingQueue>* ring = new Bench<RingQueue>;
+    double t2 = ring->run();
+    printf("mpmc+futex     : %.3f s, %.2f M req/s\n", t2, total / t2 / 1e6);
+    delete ring;
+    return 0;
+}
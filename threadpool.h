@@ -1,158 +1,644 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <list>
 #include <cstdio>
 #include <exception>
+#include <atomic>
 #include <pthread.h>
-#include "locker.h"
-
-// 线程池类，模板参数T为任务类型
+#include <unistd.h>
+#include <vector>
+#include "mpmcQueue.h"
+#include "futex.h"
+#include "codel.h"
+#include "affinity.h"
+#include "task.h"
+
+// 线程池类，模板参数T为请求类型，需提供process()处理请求和reject()拒绝请求
+// 除请求外还可以提交任意可调用对象作为后台任务，与请求共用工作线程
+// 线程数在[minThreads, maxThreads]之间，由监控线程根据排队时间和工作线程的繁忙程度调整
 template <typename T>
 class ThreadPool {
 public:
-    // 构造函数，默认线程数为8，请求队列最大值为10000
-    ThreadPool(int _threadNums = 8, int _maxReqNums = 10000);
-
-    // 析构函数
+    // 构造函数，以minThreads个线程启动，minThreads为0时取CPU核数，maxThreads为0时取minThreads的4倍
+    // 请求队列最大值maxReqNums为0时取maxThreads * 1024，向上取整为2的幂
+    // workStealing为true时每个线程拥有本地队列，空闲线程从其他线程的本地队列窃取请求
+    // shedTargetMs和shedIntervalMs为CoDel丢弃策略的参数，shedTargetMs为0表示不丢弃
+    // cpus不为空时第i个槽位上的线程绑定到cpus[i % cpus.size()]
+    ThreadPool(int _minThreads = 0, int _maxThreads = 0, int _maxReqNums = 0, bool _workStealing = false,
+               int _shedTargetMs = 5, int _shedIntervalMs = 100, const std::vector<int>& _cpus = std::vector<int>());
+
+    // 析构函数，停止并回收所有线程
     ~ThreadPool();
 
-    // 向队列中添加请求，并返回是否添加成功
+    // 向全局队列中添加请求，并返回是否添加成功
     bool appendRequest(T* req);
 
+    // 向hint选中的线程的本地队列添加请求，同一hint的请求尽量由同一线程处理
+    // 未开启工作窃取或本地队列已满时放入全局队列
+    bool appendRequest(T* req, unsigned hint);
+
+    // 提交一个后台任务，不关心其完成，任务队列已满返回false
+    template <typename F>
+    bool post(F&& f);
+
+    // 提交一个后台任务并返回其完成句柄，任务队列已满时句柄无效
+    // 线程池析构时未执行的任务被丢弃，其句柄不会完成
+    template <typename F>
+    auto submit(F&& f) -> TaskFuture<decltype(f())>;
+
+    // 队列中等待处理的请求数的近似值
+    size_t pending() const;
+
+    // 请求队列最大请求数
+    int maxRequests() const {
+        return maxReqNums;
+    }
+
+    // 线程数的上限
+    int threadLimit() const {
+        return maxThreads;
+    }
+
+    // 打印线程数、各线程处理和窃取的请求数
+    void printStats();
+
+    // 工作线程休眠前自旋尝试取请求的次数
+    static const int SPIN_COUNT = 64;
+
+    // 目标线程本地队列中的请求数超过该值且其他线程空闲时，唤醒一个空闲线程来窃取
+    static const size_t STEAL_THRESHOLD = 1;
+
+    // 监控线程调整线程数的周期，单位为毫秒
+    static const int ADJUST_INTERVAL_MS = 100;
+
+    // 繁忙比例超过GROW_BUSY_PERCENT，或平均排队时间超过GROW_WAIT_US微秒且繁忙比例超过GROW_WAIT_BUSY_PERCENT时增加线程
+    // 线程大多空闲时的排队通常是CPU被占满，加线程无济于事
+    static const int GROW_WAIT_US = 1000;
+    static const int GROW_BUSY_PERCENT = 80;
+    static const int GROW_WAIT_BUSY_PERCENT = 50;
+
+    // 后台任务队列的容量
+    static const int TASK_QUEUE_SIZE = 1024;
+
+    // 工作线程每取TASK_FAIRNESS次先看一次任务队列，持续有请求时后台任务也不会饿死
+    static const unsigned TASK_FAIRNESS = 8;
+
+    // 繁忙比例连续SHRINK_TICKS个周期低于该百分比时减少一个线程
+    static const int SHRINK_BUSY_PERCENT = 25;
+    static const int SHRINK_TICKS = 20;
+
 private:
+    // 队列中的请求及其入队时间，出队时据此计算排队时间
+    struct Entry {
+        T* req;
+        uint64_t enqueueNs;
+    };
+
+    // 每个线程槽位的状态，按缓存行对齐以避免伪共享
+    struct alignas(64) Worker {
+        Worker(ThreadPool* _pool, int _index, size_t capacity) :
+            pool(_pool), index(_index), alive(false), running(false), localQueue(capacity),
+            executed(0), stolen(0), tasks(0), waitNs(0), busyNs(0) {}
+
+        // 所属的线程池和槽位编号
+        ThreadPool* pool;
+        int index;
+
+        // 槽位上的线程，alive表示线程已创建且未被回收，只由构造、析构和监控线程访问
+        pthread_t thread;
+        bool alive;
+
+        // 为false时线程处理完本地队列后退出
+        std::atomic<bool> running;
+
+        // 本地队列，由反应堆放入，本线程和窃取者取出
+        MPMCQueue<Entry> localQueue;
+
+        // 本线程空闲时在此休眠
+        EventCount parked;
+
+        // 处理的请求数和其中从其他线程窃取的请求数
+        std::atomic<unsigned long> executed;
+        std::atomic<unsigned long> stolen;
+
+        // 执行的后台任务数
+        std::atomic<unsigned long> tasks;
+
+        // 所处理请求的排队时间之和，以及处理请求花费的时间之和
+        std::atomic<uint64_t> waitNs;
+        std::atomic<uint64_t> busyNs;
+    };
+
     // 创建线程用的回调函数
     static void* worker(void *arg);
 
     // 工作线程运行的函数，不断从请求队列中取出任务并执行
-    void run();
+    void run(int index);
 
-private:
-    // 线程数
-    int threadNums;
+    // 依次从本地队列、全局队列和其他线程的本地队列取一个请求
+    bool takeRequest(int index, Entry& entry);
+
+    // 取一个请求或后台任务，ticks为本线程取的次数，用于定期优先查看任务队列
+    bool takeWork(int index, unsigned& ticks, Entry& entry, Task& task);
+
+    // 把后台任务放入任务队列并唤醒一个线程
+    bool pushTask(Task&& task);
+
+    // 从start开始找一个休眠的线程并唤醒，返回是否唤醒了线程
+    bool wakeIdle(int start);
 
-    // 线程数组
-    pthread_t* threads;
+    // 在第activeThreads个槽位上启动线程，失败返回false
+    bool spawn();
+
+    // 停止最后一个活动槽位上的线程并等待其退出
+    void retire();
+
+    // 监控线程的回调函数和运行的函数
+    static void* monitor(void* arg);
+    void adjust();
+
+    // 停止并回收所有线程
+    void shutdown();
+
+private:
+    // 线程数的上下限和当前的线程数，槽位[0, activeThreads)上的线程在运行
+    int minThreads;
+    int maxThreads;
+    std::atomic<int> activeThreads;
 
     // 请求队列最大请求数
     int maxReqNums;
 
-    // 请求队列
-    std::list<T*> reqQueue;
+    // 是否开启工作窃取
+    bool workStealing;
+
+    // 各槽位上的线程绑定的CPU，为空表示不绑定
+    std::vector<int> cpus;
+
+    // 全局请求队列，无锁的有界环形队列
+    MPMCQueue<Entry> reqQueue;
+
+    // 后台任务队列
+    MPMCQueue<Task> taskQueue;
+
+    // 根据排队时间丢弃请求，使过载时的排队延迟保持有界
+    CoDel shedder;
 
-    // 请求队列的互斥锁
-    Locker queueLocker;
+    // 未开启工作窃取时，空闲的工作线程在此休眠
+    EventCount idleWorkers;
 
-    // 是否有任务需要处理
-    Sem queueStat;
+    // maxThreads个线程槽位
+    Worker** workers;
+
+    // 监控线程，monitorWake用于在析构时唤醒它
+    pthread_t monitorThread;
+    bool monitorAlive;
+    std::atomic<uint32_t> monitorWake;
+
+    // 最近一个监控周期测得的平均排队时间（微秒）和繁忙比例（百分比）
+    std::atomic<unsigned long> lastWaitUs;
+    std::atomic<int> lastBusyPercent;
 
     // 是否结束线程池中的线程
-    bool stopThread;
+    std::atomic<bool> stopThread;
 };
 
 // 构造函数
 template <typename T>
-ThreadPool<T>::ThreadPool(int _threadNums, int _maxReqNUms) :
-    threadNums(_threadNums), maxReqNums(_maxReqNUms),
-    stopThread(false), threads(nullptr)
+ThreadPool<T>::ThreadPool(int _minThreads, int _maxThreads, int _maxReqNums, bool _workStealing,
+                          int _shedTargetMs, int _shedIntervalMs, const std::vector<int>& _cpus) :
+    minThreads(_minThreads > 0 ? _minThreads : (int)sysconf(_SC_NPROCESSORS_ONLN)),
+    maxThreads(_maxThreads > 0 ? _maxThreads : minThreads * 4),
+    activeThreads(0),
+    maxReqNums(_maxReqNums > 0 ? _maxReqNums : maxThreads * 1024),
+    workStealing(_workStealing),
+    cpus(_cpus),
+    reqQueue(maxReqNums > 0 ? maxReqNums : 1),
+    taskQueue(TASK_QUEUE_SIZE),
+    shedder((uint64_t)_shedTargetMs * 1000000, (uint64_t)_shedIntervalMs * 1000000),
+    workers(nullptr), monitorAlive(false), monitorWake(0),
+    lastWaitUs(0), lastBusyPercent(0), stopThread(false)
 {
     // 数据有误，抛出异常
-    if (threadNums <= 0 || maxReqNums <= 0) {
+    if (minThreads <= 0 || maxThreads < minThreads || maxReqNums <= 0 ||
+        _shedTargetMs < 0 || _shedIntervalMs <= 0) {
         throw std::exception();
     }
 
-    // 初始化线程数组
-    threads = new pthread_t[threadNums];
-    if (!threads) {
-        throw std::exception();
+    // 初始化所有槽位，本地队列平分请求队列的容量
+    workers = new Worker*[maxThreads];
+    for (int i = 0; i < maxThreads; i++) {
+        workers[i] = new Worker(this, i, workStealing ? (maxReqNums + maxThreads - 1) / maxThreads : 1);
     }
 
-    // 创建threadNums个线程，并设置为线程分离
-    // 线程分离：线程结束时，它的资源会被系统自动的回收，而不再需要在其它线程中对其进行pthread_join()操作
-    for (int i = 0; i < threadNums; i++) {
-        // 创建线程
-        printf("Create the %dth thread\n", i);
-        if (pthread_create(threads + i, nullptr, worker, this) != 0) {
-            delete [] threads;
+    // 先启动minThreads个线程，线程不再分离，缩容和析构时等待其退出
+    for (int i = 0; i < minThreads; i++) {
+        if (!spawn()) {
+            shutdown();
             throw std::exception();
         }
+    }
 
-        // 设置为线程分离
-        if (pthread_detach(threads[i]) != 0) {
-            delete [] threads;
+    // 线程数可变时才需要监控线程
+    if (maxThreads > minThreads) {
+        if (pthread_create(&monitorThread, nullptr, monitor, this) != 0) {
+            shutdown();
             throw std::exception();
         }
+        monitorAlive = true;
     }
 }
 
-// 析构函数，回收内存空间，停止线程
+// 析构函数
 template<typename T>
 ThreadPool<T>::~ThreadPool() {
-    delete [] threads;
+    shutdown();
+}
+
+// 停止并回收所有线程
+template<typename T>
+void ThreadPool<T>::shutdown() {
+    if (!workers) {
+        return;
+    }
+
+    // 先停止监控线程，此后只有本线程改变槽位
     stopThread = true;
+    if (monitorAlive) {
+        monitorWake.fetch_add(1);
+        futexWake(&monitorWake, 1);
+        pthread_join(monitorThread, nullptr);
+        monitorAlive = false;
+    }
+
+    // 唤醒所有休眠的线程，它们看到stopThread后退出
+    idleWorkers.notifyAll();
+    for (int i = 0; i < maxThreads; i++) {
+        workers[i]->running = false;
+        workers[i]->parked.notifyAll();
+    }
+    for (int i = 0; i < maxThreads; i++) {
+        if (workers[i]->alive) {
+            pthread_join(workers[i]->thread, nullptr);
+        }
+        delete workers[i];
+    }
+    delete [] workers;
+    workers = nullptr;
+}
+
+// 在第activeThreads个槽位上启动线程
+template<typename T>
+bool ThreadPool<T>::spawn() {
+    int index = activeThreads.load();
+    Worker* slot = workers[index];
+    slot->running = true;
+    if (pthread_create(&slot->thread, nullptr, worker, slot) != 0) {
+        slot->running = false;
+        return false;
+    }
+    printf("Create the %dth thread\n", index);
+    slot->alive = true;
+    activeThreads.store(index + 1);
+    return true;
+}
+
+// 停止最后一个活动槽位上的线程
+template<typename T>
+void ThreadPool<T>::retire() {
+    int index = activeThreads.load() - 1;
+    Worker* slot = workers[index];
+
+    // 先不再向该槽位分配请求，再通知线程退出，它会处理完本地队列中剩余的请求
+    activeThreads.store(index);
+    slot->running = false;
+    slot->parked.notifyAll();
+    idleWorkers.notifyAll();
+    pthread_join(slot->thread, nullptr);
+    slot->alive = false;
 }
 
-// 向工作队列中添加请求
+// 向全局队列中添加请求
 template<typename T>
 bool ThreadPool<T>::appendRequest(T* req) {
-    // 对队列加锁
-    queueLocker.lock();
+    Entry entry = {req, monotonicNs()};
 
-    // 添加请求至队列末尾，若超过最大值，解锁,返回添加失败
-    if (reqQueue.size() > maxReqNums) {
-        queueLocker.unlock();
+    // 队列已满，返回添加失败
+    if (!reqQueue.push(entry)) {
         return false;
     }
-    reqQueue.push_back(req);
-
-    // 对队列解锁
-    queueLocker.unlock();
 
-    // 待处理请求加一
-    queueStat.post();
+    // 有线程在休眠时才唤醒一个
+    if (workStealing) {
+        wakeIdle(0);
+    } else {
+        idleWorkers.notify(1);
+    }
 
     // 返回添加成功
     return true;
 }
 
+// 向hint选中的线程的本地队列添加请求
+template<typename T>
+bool ThreadPool<T>::appendRequest(T* req, unsigned hint) {
+    if (!workStealing) {
+        return appendRequest(req);
+    }
+
+    int index = hint % activeThreads.load(std::memory_order_relaxed);
+    Worker* target = workers[index];
+    Entry entry = {req, monotonicNs()};
+    if (!target->localQueue.push(entry)) {
+        // 本地队列已满，交给任意线程处理
+        return appendRequest(req);
+    }
+
+    // 目标线程在休眠则唤醒它；它正忙且积压了请求，或刚被停止时，唤醒一个空闲线程来窃取
+    if (!target->parked.notify(1) &&
+        (!target->running.load() || target->localQueue.size() > STEAL_THRESHOLD)) {
+        wakeIdle(index + 1);
+    }
+    return true;
+}
+
+// 提交一个后台任务
+template<typename T>
+template<typename F>
+bool ThreadPool<T>::post(F&& f) {
+    return pushTask(Task(std::forward<F>(f)));
+}
+
+// 提交一个后台任务并返回其完成句柄
+template<typename T>
+template<typename F>
+auto ThreadPool<T>::submit(F&& f) -> TaskFuture<decltype(f())> {
+    typedef decltype(f()) R;
+    typedef typename std::decay<F>::type Fn;
+
+    // 任务持有可调用对象和与句柄共享的完成状态，完成状态需要一次堆分配
+    std::shared_ptr<TaskState<R>> state = std::make_shared<TaskState<R>>();
+    Task task([state, fn = Fn(std::forward<F>(f))]() mutable {
+        state->run(fn);
+    });
+    if (!pushTask(std::move(task))) {
+        return TaskFuture<R>();
+    }
+    return TaskFuture<R>(std::move(state));
+}
+
+// 把后台任务放入任务队列并唤醒一个线程
+template<typename T>
+bool ThreadPool<T>::pushTask(Task&& task) {
+    if (!taskQueue.push(std::move(task))) {
+        return false;
+    }
+    if (workStealing) {
+        wakeIdle(0);
+    } else {
+        idleWorkers.notify(1);
+    }
+    return true;
+}
+
+// 从start开始找一个休眠的线程并唤醒
+template<typename T>
+bool ThreadPool<T>::wakeIdle(int start) {
+    for (int i = 0; i < maxThreads; i++) {
+        if (workers[(start + i) % maxThreads]->parked.notify(1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 队列中等待处理的请求数的近似值
+template<typename T>
+size_t ThreadPool<T>::pending() const {
+    size_t n = reqQueue.size();
+    if (workStealing) {
+        for (int i = 0; i < maxThreads; i++) {
+            n += workers[i]->localQueue.size();
+        }
+    }
+    return n;
+}
+
+// 打印线程数、各线程处理和窃取的请求数
+template<typename T>
+void ThreadPool<T>::printStats() {
+    printf("thread pool: %d threads (min %d, max %d), wait %lu us, busy %d%%, %s, global queue %zu/%zu, "
+           "task queue %zu/%zu, shed %lu\n",
+           activeThreads.load(), minThreads, maxThreads, lastWaitUs.load(), lastBusyPercent.load(),
+           workStealing ? "work stealing" : "shared queue", reqQueue.size(), reqQueue.capacity(),
+           taskQueue.size(), taskQueue.capacity(), shedder.droppedCount());
+    for (int i = 0; i < maxThreads; i++) {
+        unsigned long executed = workers[i]->executed.load(std::memory_order_relaxed);
+        if (executed == 0 && i >= activeThreads.load()) {
+            continue;
+        }
+        printf("    worker %d: executed %lu, stolen %lu, tasks %lu, local queue %zu%s\n", i, executed,
+               workers[i]->stolen.load(std::memory_order_relaxed),
+               workers[i]->tasks.load(std::memory_order_relaxed),
+               workers[i]->localQueue.size(), i < activeThreads.load() ? "" : " (stopped)");
+    }
+}
+
 // 回调函数，执行线程中的任务
 template<typename T>
 void* ThreadPool<T>::worker(void* arg) {
-    // 入参arg表示线程所在的线程池
-    ThreadPool* pool = (ThreadPool*)arg;
+    // 入参arg表示线程所在的槽位
+    Worker* slot = (Worker*)arg;
+
+    // 先绑定CPU，线程缓存的缓冲区据此在本节点上分配
+    const std::vector<int>& cpus = slot->pool->cpus;
+    if (!cpus.empty()) {
+        pinCurrentThread(cpus[slot->index % cpus.size()]);
+    }
 
     // 执行工作函数
-    pool->run();
+    slot->pool->run(slot->index);
 
     // 返回线程所在的线程池
+    return slot->pool;
+}
+
+// 监控线程的回调函数
+template<typename T>
+void* ThreadPool<T>::monitor(void* arg) {
+    ThreadPool* pool = (ThreadPool*)arg;
+    pool->adjust();
     return pool;
 }
 
+// 每个周期统计平均排队时间和繁忙比例，据此增减线程
+template<typename T>
+void ThreadPool<T>::adjust() {
+    uint64_t lastExecuted = 0, lastWait = 0, lastBusy = 0;
+    uint64_t lastTime = monotonicNs();
+    int quietTicks = 0;
+
+    struct timespec interval;
+    interval.tv_sec = 0;
+    interval.tv_nsec = ADJUST_INTERVAL_MS * 1000000L;
+
+    while (!stopThread) {
+        uint32_t key = monitorWake.load();
+        futexWait(&monitorWake, key, &interval);
+        if (stopThread) {
+            break;
+        }
+
+        // 汇总所有槽位的计数，包括已停止的
+        uint64_t executed = 0, wait = 0, busy = 0;
+        for (int i = 0; i < maxThreads; i++) {
+            executed += workers[i]->executed.load(std::memory_order_relaxed);
+            wait += workers[i]->waitNs.load(std::memory_order_relaxed);
+            busy += workers[i]->busyNs.load(std::memory_order_relaxed);
+        }
+        uint64_t now = monotonicNs();
+        int active = activeThreads.load();
+
+        uint64_t dExecuted = executed - lastExecuted;
+        uint64_t waitUs = dExecuted ? (wait - lastWait) / dExecuted / 1000 : 0;
+        int busyPercent = (int)((busy - lastBusy) * 100 / ((now - lastTime) * active));
+        lastExecuted = executed;
+        lastWait = wait;
+        lastBusy = busy;
+        lastTime = now;
+        lastWaitUs = waitUs;
+        lastBusyPercent = busyPercent;
+
+        bool queued = waitUs > (uint64_t)GROW_WAIT_US && busyPercent > GROW_WAIT_BUSY_PERCENT;
+        if (active < maxThreads && (queued || busyPercent > GROW_BUSY_PERCENT)) {
+            // 线程都在忙，按当前线程数的四分之一扩容，至少一个
+            int target = active + (active / 4 > 1 ? active / 4 : 1);
+            if (target > maxThreads) {
+                target = maxThreads;
+            }
+            while (activeThreads.load() < target && spawn()) {
+            }
+            printf("thread pool: grow to %d threads (wait %lu us, busy %d%%)\n",
+                   activeThreads.load(), (unsigned long)waitUs, busyPercent);
+            quietTicks = 0;
+        } else if (active > minThreads && busyPercent < SHRINK_BUSY_PERCENT &&
+                   waitUs < (uint64_t)GROW_WAIT_US / 4) {
+            // 持续空闲一段时间后才缩容，避免在突发流量间隙来回增减
+            if (++quietTicks >= SHRINK_TICKS) {
+                retire();
+                printf("thread pool: shrink to %d threads (wait %lu us, busy %d%%)\n",
+                       activeThreads.load(), (unsigned long)waitUs, busyPercent);
+                quietTicks = 0;
+            }
+        } else {
+            quietTicks = 0;
+        }
+    }
+}
+
+// 依次从本地队列、全局队列和其他线程的本地队列取一个请求
+template<typename T>
+bool ThreadPool<T>::takeRequest(int index, Entry& entry) {
+    if (!workStealing) {
+        return reqQueue.pop(entry);
+    }
+
+    Worker* self = workers[index];
+    if (self->localQueue.pop(entry) || reqQueue.pop(entry)) {
+        return true;
+    }
+
+    // 从相邻的槽位开始窃取，包括已停止的槽位中遗留的请求，取走的是其队列中最早的请求
+    for (int i = 1; i < maxThreads; i++) {
+        if (workers[(index + i) % maxThreads]->localQueue.pop(entry)) {
+            self->stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+// 取一个请求或后台任务
+template<typename T>
+bool ThreadPool<T>::takeWork(int index, unsigned& ticks, Entry& entry, Task& task) {
+    if (++ticks % TASK_FAIRNESS == 0 && taskQueue.pop(task)) {
+        return true;
+    }
+    return takeRequest(index, entry) || taskQueue.pop(task);
+}
+
 // 工作函数
 template<typename T>
-void ThreadPool<T>::run() {
+void ThreadPool<T>::run(int index) {
+    Worker* self = workers[index];
+    EventCount& parked = workStealing ? self->parked : idleWorkers;
+    unsigned ticks = 0;
+    Task task;
+
     // 若线程池未停止，循环执行
     while (!stopThread) {
-        // 等待是否有待处理的线程
-        queueStat.wait();
+        Entry entry = {nullptr, 0};
+
+        if (!self->running.load()) {
+            // 被停止后只处理完本地队列中剩余的请求
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!self->localQueue.pop(entry)) {
+                break;
+            }
+        }
 
-        // 对请求队列加锁
-        queueLocker.lock();
+        // 先自旋尝试几次，请求密集时避免休眠和唤醒的系统调用
+        bool got = entry.req != nullptr;
+        for (int i = 0; i < SPIN_COUNT && !got; i++) {
+            got = takeWork(index, ticks, entry, task);
+            if (!got) {
+                cpuRelax();
+            }
+        }
+
+        if (!got) {
+            // 登记后再检查一次队列，避免错过登记前入队的请求
+            uint32_t key = parked.prepareWait();
+            got = takeWork(index, ticks, entry, task);
+            if (got || stopThread || !self->running.load()) {
+                parked.cancelWait();
+            } else {
+                parked.wait(key);
+                continue;
+            }
+        }
 
-        // 取出队头的请求
-        if (reqQueue.empty()) {
-            queueLocker.unlock();
+        if (task) {
+            // 执行后台任务，任务自己的异常不能结束工作线程
+            uint64_t start = monotonicNs();
+            try {
+                task();
+            } catch (...) {
+                printf("thread pool: background task threw an exception\n");
+            }
+            task = Task();
+            self->tasks.fetch_add(1, std::memory_order_relaxed);
+            self->busyNs.fetch_add(monotonicNs() - start, std::memory_order_relaxed);
             continue;
         }
-        T* req = reqQueue.front();
-        reqQueue.pop_front();
 
-        // 对请求队列解锁
-        queueLocker.unlock();
+        if (!entry.req) {
+            continue;
+        }
+
+        // 排队时间持续过长时直接拒绝，不再解析请求
+        uint64_t start = monotonicNs();
+        uint64_t wait = start - entry.enqueueNs;
+        if (shedder.shouldDrop(start, wait)) {
+            entry.req->reject();
+        } else {
+            entry.req->process();
+        }
 
-        // 处理请求
-        req->process();
+        self->executed.fetch_add(1, std::memory_order_relaxed);
+        self->waitNs.fetch_add(wait, std::memory_order_relaxed);
+        self->busyNs.fetch_add(monotonicNs() - start, std::memory_order_relaxed);
     }
 }
 
-#endif
\ No newline at end of file
+#endif
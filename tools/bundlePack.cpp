@@ -0,0 +1,274 @@
+// 静态资源打包工具，把网站根目录打包成服务器-B选项使用的资源包，格式见bundle.h
+// 每个文件预先生成保持连接和关闭连接两种响应头部，带有与服务器相同的Last-Modified和ETag，可压缩的文本文件还可以附带gzip版本
+// 编译: g++ -O2 -pthread -I.. bundlePack.cpp ../fileCache.cpp ../compression.cpp -lz -lbrotlienc -o bundlePack
+// 用法: ./bundlePack [-z] [-m min_gzip_bytes] doc_root bundle_file
+//   -z  为可压缩的文本文件生成gzip版本，压缩后不小于原大小的90%时不保留
+//   -m  小于该字节数的文件不压缩，默认256
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "bundle.h"
+#include "compression.h"
+#include "fileCache.h"
+
+// 一个待打包的文件
+struct PackFile {
+    std::string path;       // 请求路径，以'/'开头
+    std::string fsPath;     // 文件系统中的路径
+    off_t size;
+    const char* mimeType;
+    Validators validators;
+    std::string gzip;       // 压缩后的内容，为空表示没有压缩版本
+    std::string headers[BUNDLE_ENCODINGS][2];
+};
+
+// 递归列出dir下的所有普通文件，跳过以'.'开头的名字，与服务器的预热使用同样的规则
+static void listFiles(const std::string& root, const std::string& dir, std::vector<PackFile>& out) {
+    std::string full = root + dir;
+    DIR* d = opendir(full.c_str());
+    if (!d) {
+        return;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        std::string path = dir + "/" + ent->d_name;
+        struct stat st;
+        if (stat((root + path).c_str(), &st) < 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            listFiles(root, path, out);
+        } else if (S_ISREG(st.st_mode) && (st.st_mode & S_IROTH)) {
+            // 服务器对其他用户不可读的文件回复403，这里不打包
+            PackFile file;
+            file.path = path;
+            file.fsPath = root + path;
+            file.size = st.st_size;
+            file.mimeType = mimeType(path.c_str());
+            makeValidators(st, file.validators);
+            out.push_back(file);
+        }
+    }
+    closedir(d);
+}
+
+// 读取整个文件
+static bool readFile(const std::string& path, std::string& data) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        data.append(buf, n);
+    }
+    close(fd);
+    return n == 0;
+}
+
+// 资源包的编码对应的内容编码
+static CONTENT_ENCODING contentEncoding(int encoding) {
+    return encoding == BUNDLE_GZIP ? ENCODING_GZIP : ENCODING_IDENTITY;
+}
+
+// 生成与服务器常规方式完全相同的响应头部，有压缩版本的文件两种编码都带Vary
+static std::string makeHeaders(const PackFile& file, int encoding, bool keepAlive) {
+    char buf[512];
+    off_t len = encoding == BUNDLE_GZIP ? (off_t)file.gzip.size() : file.size;
+    int n = snprintf(buf, sizeof(buf), "HTTP/1.1 200 OK\r\nContent-Length: %lld\r\nContent-Type:%s\r\n%s%s"
+                     "Last-Modified: %s\r\nETag: %s\r\nConnection: %s\r\n\r\n",
+                     (long long)len, file.mimeType, encoding == BUNDLE_GZIP ? "Content-Encoding: gzip\r\n" : "",
+                     file.gzip.empty() ? "" : "Vary: Accept-Encoding\r\n", file.validators.lastModified,
+                     file.validators.etags[contentEncoding(encoding)], keepAlive ? "keep-alive" : "close");
+    return std::string(buf, n);
+}
+
+// 把文件内容复制到输出，大小必须与列出时一致
+static bool copyFile(const PackFile& file, FILE* out) {
+    int fd = open(file.fsPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char buf[1 << 16];
+    off_t done = 0;
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        if (fwrite(buf, 1, n, out) != (size_t)n) {
+            break;
+        }
+        done += n;
+    }
+    close(fd);
+    return n == 0 && done == file.size;
+}
+
+static void usage(const char* prog) {
+    printf("usage: %s [-z] [-m min_gzip_bytes] doc_root bundle_file\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    bool gzip = false;
+    long minGzip = 256;
+    int opt;
+    while ((opt = getopt(argc, argv, "zm:")) != -1) {
+        switch (opt) {
+            case 'z':
+                gzip = true;
+                break;
+            case 'm':
+                minGzip = atol(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string root = argv[optind];
+    while (root.size() > 1 && root.back() == '/') {
+        root.pop_back();
+    }
+    const char* outPath = argv[optind + 1];
+
+    std::vector<PackFile> files;
+    listFiles(root, "", files);
+    if (files.empty()) {
+        printf("no files under %s\n", root.c_str());
+        return 1;
+    }
+
+    // 压缩并生成头部，压缩版本留在内存中，原始内容写出时再读取
+    uint64_t gzipFiles = 0, gzipSaved = 0;
+    for (PackFile& file : files) {
+        if (gzip && file.size >= minGzip && compressible(file.mimeType)) {
+            std::string data, packed;
+            if (!readFile(file.fsPath, data) || (off_t)data.size() != file.size) {
+                printf("read %s failed\n", file.fsPath.c_str());
+                return 1;
+            }
+            if (compress(ENCODING_GZIP, data.data(), data.size(), packed) && packed.size() * 10 < data.size() * 9) {
+                file.gzip.swap(packed);
+                gzipFiles++;
+                gzipSaved += data.size() - file.gzip.size();
+            }
+        }
+        for (int enc = 0; enc < BUNDLE_ENCODINGS; enc++) {
+            if (enc == BUNDLE_IDENTITY || !file.gzip.empty()) {
+                file.headers[enc][0] = makeHeaders(file, enc, true);
+                file.headers[enc][1] = makeHeaders(file, enc, false);
+            }
+        }
+    }
+
+    // 哈希槽数取文件数两倍以上的2的幂，线性探测
+    BundleHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(header.magic));
+    header.version = BUNDLE_VERSION;
+    header.count = files.size();
+    header.slotCount = 1;
+    while (header.slotCount < header.count * 2) {
+        header.slotCount <<= 1;
+    }
+    header.slotsOffset = sizeof(BundleHeader);
+    header.entriesOffset = header.slotsOffset + (uint64_t)header.slotCount * sizeof(uint32_t);
+    header.entriesOffset = (header.entriesOffset + 7) & ~7ULL;
+
+    // 每个文件的数据依次为：路径、各编码的关闭连接头部、保持连接头部、内容
+    // 保持连接的头部紧接在内容之前，服务器发送时与内容合并为一个内存段
+    std::vector<BundleEntry> entries(files.size());
+    std::vector<uint32_t> slots(header.slotCount, 0);
+    uint64_t offset = header.entriesOffset + (uint64_t)files.size() * sizeof(BundleEntry);
+    for (size_t i = 0; i < files.size(); i++) {
+        const PackFile& file = files[i];
+        BundleEntry& e = entries[i];
+        memset(&e, 0, sizeof(e));
+        e.hash = bundleHash(file.path.data(), file.path.size());
+        e.pathOffset = offset;
+        e.pathLen = file.path.size();
+        offset += file.path.size();
+        e.mtime = file.validators.mtime;
+        memcpy(e.lastModified, file.validators.lastModified, sizeof(e.lastModified));
+        for (int enc = 0; enc < BUNDLE_ENCODINGS; enc++) {
+            memcpy(e.etag[enc], file.validators.etags[contentEncoding(enc)], sizeof(e.etag[enc]));
+        }
+        for (int enc = BUNDLE_ENCODINGS - 1; enc >= 0; enc--) {
+            if (enc != BUNDLE_IDENTITY && file.gzip.empty()) {
+                continue;
+            }
+            for (int close = 1; close >= 0; close--) {
+                e.headerOffset[enc][close] = offset;
+                e.headerLen[enc][close] = file.headers[enc][close].size();
+                offset += file.headers[enc][close].size();
+            }
+            e.bodyOffset[enc] = offset;
+            e.bodyLen[enc] = enc == BUNDLE_GZIP ? file.gzip.size() : file.size;
+            offset += e.bodyLen[enc];
+        }
+
+        uint32_t mask = header.slotCount - 1;
+        uint32_t slot = e.hash & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = i + 1;
+    }
+    header.size = offset;
+
+    FILE* out = fopen(outPath, "wb");
+    if (!out) {
+        printf("open %s failed, errno is: %d\n", outPath, errno);
+        return 1;
+    }
+    static const char zeros[8] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(slots.data(), sizeof(uint32_t), slots.size(), out) == slots.size() &&
+              fwrite(zeros, 1, header.entriesOffset - header.slotsOffset - slots.size() * sizeof(uint32_t), out) ==
+                  header.entriesOffset - header.slotsOffset - slots.size() * sizeof(uint32_t) &&
+              fwrite(entries.data(), sizeof(BundleEntry), entries.size(), out) == entries.size();
+    for (size_t i = 0; i < files.size() && ok; i++) {
+        const PackFile& file = files[i];
+        ok = fwrite(file.path.data(), 1, file.path.size(), out) == file.path.size();
+        for (int enc = BUNDLE_ENCODINGS - 1; enc >= 0 && ok; enc--) {
+            if (enc != BUNDLE_IDENTITY && file.gzip.empty()) {
+                continue;
+            }
+            for (int close = 1; close >= 0 && ok; close--) {
+                ok = fwrite(file.headers[enc][close].data(), 1, file.headers[enc][close].size(), out) ==
+                     file.headers[enc][close].size();
+            }
+            if (ok && enc == BUNDLE_GZIP) {
+                ok = fwrite(file.gzip.data(), 1, file.gzip.size(), out) == file.gzip.size();
+            } else if (ok) {
+                ok = copyFile(file, out);
+                if (!ok) {
+                    printf("%s changed or unreadable while packing\n", file.fsPath.c_str());
+                }
+            }
+        }
+    }
+    if (fclose(out) != 0 || !ok) {
+        printf("write %s failed\n", outPath);
+        unlink(outPath);
+        return 1;
+    }
+
+    printf("packed %zu files (%.1f MB) into %s, %lu gzip variants saving %.1f KB\n", files.size(),
+           header.size / 1048576.0, outPath, (unsigned long)gzipFiles, gzipSaved / 1024.0);
+    return 0;
+}